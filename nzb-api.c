@@ -0,0 +1,210 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "nzb-api.h"
+#include "nzb-scan.h"
+
+struct sNzbParser {
+    tDocument  document;
+    tParser  * parser;
+};
+
+/* what parseNzb() collects the files into */
+typedef struct {
+    tNzbFiles * result;
+    size_t      capacity;
+    size_t    * offsets;        // of each file's subject, until they stop moving
+    size_t      length;         // of the subjects so far
+    size_t      size;
+    bool        failed;
+} tCollector;
+
+/**
+ * split a path off the filename: "/dir/sub/name.mkv" is the filename
+ * "name.mkv" in the directory "dir/sub".
+ */
+static void splitDirectory(tFileResult * file, tSpan path) {
+    const char * start = file->subject + path.offset;
+    const char * slash = NULL;
+    for ( const char * p = start + path.length; p > start; p-- ) {
+        if ( p[ -1 ] == '/' ) {
+            slash = p - 1;
+            break;
+        }
+    }
+
+    file->filename = path;
+    file->directory = (tSpan) { 0, 0 };
+    if ( slash != NULL) {
+        unsigned int skip = *start == '/' ? 1 : 0;
+        file->directory = (tSpan) { path.offset + skip, (unsigned int) (slash - start) - skip };
+        file->filename = (tSpan) { (unsigned int) (slash + 1 - file->subject),
+                                   (unsigned int) (start + path.length - (slash + 1)) };
+    }
+}
+
+/** @return the number of digits at p, up to end, with their value (or UINT_MAX, if too big) in value */
+static size_t takeNumber(const char * p, const char * end, unsigned int * value) {
+    uint64_t number;
+    size_t count = parseDecimal((const byte *) p, (const byte *) end, &number);
+    *value = number > UINT_MAX ? UINT_MAX : (unsigned int) number;
+    return count;
+}
+
+/** find the last "(n/m)" in the yEnc suffix, that follows the trimmed subject */
+static void findParts(tFileResult * file, size_t trimmed) {
+    const char * start = file->subject + trimmed;
+    const char * end = file->subject + file->length;
+
+    file->part = file->parts = 0;
+    for ( const char * p = end; p > start; p-- ) {
+        if ( p[ -1 ] == '(' ) {
+            unsigned int part, parts;
+            size_t n = takeNumber(p, end, &part);
+            if ( n > 0 && p + n < end && p[ n ] == '/' ) {
+                const char * q = p + n + 1;
+                size_t m = takeNumber(q, end, &parts);
+                if ( m > 0 && q + m < end && q[ m ] == ')' ) {
+                    file->part = part;
+                    file->parts = parts;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void describeFile(tFileResult * file, const char * subject, size_t length, const tSubjectInfo * info) {
+    file->subject = subject;
+    file->length = length;
+    splitDirectory(file, info->filename);
+    file->index = info->index;
+    file->total = info->total;
+    file->confident = info->confident;
+    findParts(file, info->trimmed.length);
+    file->family = classifyFamily((const byte *) subject, info->trimmed.length);
+}
+
+tNzbParser * createNzbParser(tParseFlags flags, tFileCallback onFile, void * context) {
+    tNzbParser * parser = calloc(1, sizeof(tNzbParser));
+    if ( parser == NULL) {
+        return NULL;
+    }
+
+    /* nothing is printed: the callback gets it all */
+    parser->document.flags = flags & ~(kParse_Statistics | kParse_Results | kParse_Tokens | kParse_Prefilter | kParse_Split);
+    parser->document.out = NULL;
+    parser->document.threads = 1;
+    parser->document.onFile = onFile;
+    parser->document.context = context;
+
+    parser->parser = createParser(&parser->document);
+    if ( parser->parser == NULL) {
+        free(parser);
+        return NULL;
+    }
+    return parser;
+}
+
+int feedNzbParser(tNzbParser * parser, const void * data, size_t length) {
+    return feedParser(parser->parser, data, length);
+}
+
+int finishNzbParser(tNzbParser * parser) {
+    int result = finishParser(parser->parser);
+    releaseDocument(&parser->document);
+    free(parser);
+    return result;
+}
+
+/** onFile callback for parseNzb(): keep a copy of the file, and of its subject */
+static void collectFile(void * context, const tFileResult * file) {
+    tCollector * collector = context;
+    tNzbFiles * result = collector->result;
+    if ( collector->failed ) {
+        return;
+    }
+
+    if ( result->count == collector->capacity ) {
+        size_t capacity = collector->capacity == 0 ? 64 : collector->capacity * 2;
+        tFileResult * files = realloc(result->files, capacity * sizeof(tFileResult));
+        size_t * offsets = realloc(collector->offsets, capacity * sizeof(size_t));
+        if ( files != NULL) {
+            result->files = files;
+        }
+        if ( offsets != NULL) {
+            collector->offsets = offsets;
+        }
+        if ( files == NULL || offsets == NULL) {
+            collector->failed = true;
+            return;
+        }
+        collector->capacity = capacity;
+    }
+    if ( collector->length + file->length + 1 > collector->size ) {
+        size_t size = collector->size == 0 ? 4096 : collector->size;
+        while ( size < collector->length + file->length + 1 ) {
+            size *= 2;
+        }
+        char * subjects = realloc(result->subjects, size);
+        if ( subjects == NULL) {
+            collector->failed = true;
+            return;
+        }
+        result->subjects = subjects;
+        collector->size = size;
+    }
+
+    memcpy(result->subjects + collector->length, file->subject, file->length);
+    result->subjects[ collector->length + file->length ] = '\0';
+    collector->offsets[ result->count ] = collector->length;
+    collector->length += file->length + 1;
+    result->files[ result->count++ ] = *file;
+}
+
+int parseNzb(const void * data, size_t length, tParseFlags flags, tNzbFiles * files) {
+    memset(files, 0, sizeof(tNzbFiles));
+    tCollector collector = { .result = files };
+
+    tNzbParser * parser = createNzbParser(flags, collectFile, &collector);
+    if ( parser == NULL) {
+        return -ENOMEM;
+    }
+    feedNzbParser(parser, data, length);
+    int result = finishNzbParser(parser);
+
+    /* the subjects are where they'll stay, now */
+    for ( size_t i = 0; i < files->count; i++ ) {
+        files->files[ i ].subject = files->subjects + collector.offsets[ i ];
+    }
+    free(collector.offsets);
+    return collector.failed ? -ENOMEM : result;
+}
+
+void releaseNzbFiles(tNzbFiles * files) {
+    free(files->files);
+    free(files->subjects);
+    memset(files, 0, sizeof(tNzbFiles));
+}
+
+int indexNzb(const void * data, size_t length, tParseFlags flags, tNzbIndex * index) {
+    initIndex(index);
+    tDocument document = {
+        .flags = flags & ~(kParse_Statistics | kParse_Results | kParse_Tokens | kParse_Prefilter | kParse_Split),
+        .threads = 1,
+        .index = index
+    };
+
+    tParser * parser = createParser(&document);
+    if ( parser == NULL) {
+        return -ENOMEM;
+    }
+    feedParser(parser, data, length);
+    int result = finishParser(parser);
+    releaseDocument(&document);
+    trimIndex(index);
+    return index->failed ? -ENOMEM : result;
+}
@@ -0,0 +1,91 @@
+
+#ifndef NZB_API_H
+#define NZB_API_H
+
+/*
+ * libnzbsubject: the parser for embedding, instead of running nzb-subject.
+ * Feed it an NZB, in pieces as they arrive or all at once, and get a
+ * tFileResult for each <file> in it, or an index of the whole NZB. Nothing
+ * is printed, and there's no global state: every parser is independent of
+ * the others, so any number can be used at once, on as many threads.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nzb-subject.h"
+#include "nzb-family.h"
+#include "nzb-index.h"
+
+struct sFileResult {
+    const char   * subject;     // not necessarily zero-terminated
+    size_t         length;
+    tSpan          filename;    // of the subject, without any directory: length 0 if none was found
+    tSpan          directory;   // of the subject, the path in front of the filename: length 0 if none
+    unsigned int   index;       // the subject's n/m counter: which file of the post this is,
+    unsigned int   total;       //   0/0 if it has none
+    unsigned int   part;        // the (n/m) after yEnc: which part of the file this <file>
+    unsigned int   parts;       //   was posted as, 0/0 if it has none
+    tSubjectFamily family;
+    bool           confident;   // the filename and counter were both found
+    unsigned int   segments;    // both 0 with kParse_SubjectsOnly, which skips the segments
+    uint64_t       bytes;
+};
+
+/**
+ * fill in the file's subject, and everything that depends only on it, from
+ * what processSubject() made of it. The segments and bytes are left alone.
+ */
+void describeFile(tFileResult * file, const char * subject, size_t length, const tSubjectInfo * info);
+
+typedef struct sNzbParser tNzbParser;
+
+/**
+ * @param flags any of kParse_ByteWise, _SubjectsOnly, _Templates, _Families
+ *        and _EarlyExit; the whole-document engines don't apply
+ * @param onFile called with each file as soon as its end tag is parsed.
+ *        The result, and the subject it points to, are only valid during
+ *        the call.
+ * @return a parser, or NULL if out of memory
+ */
+tNzbParser * createNzbParser(tParseFlags flags, tFileCallback onFile, void * context);
+
+/**
+ * parse the next length bytes of the NZB, which can be cut anywhere.
+ * @return 0, or the first negative yxml_ret_t error; after one, any further
+ *         data is ignored
+ */
+int feedNzbParser(tNzbParser * parser, const void * data, size_t length);
+
+/**
+ * check the NZB was complete, and free the parser.
+ * @return 0, or the first error, or YXML_EEOF if the NZB was truncated
+ */
+int finishNzbParser(tNzbParser * parser);
+
+/* every file of an NZB, with copies of their subjects */
+typedef struct {
+    tFileResult * files;
+    size_t        count;
+    char        * subjects;     // where the files' subjects are kept
+} tNzbFiles;
+
+/**
+ * parse a whole NZB held in memory, collecting its files.
+ * @return as finishNzbParser(), or -ENOMEM. Either way, files holds
+ *         whatever was parsed, and must be released with releaseNzbFiles().
+ */
+int parseNzb(const void * data, size_t length, tParseFlags flags, tNzbFiles * files);
+
+void releaseNzbFiles(tNzbFiles * files);
+
+/**
+ * parse a whole NZB held in memory into an index of its files, segments
+ * and groups (see nzb-index.h), trimmed to size for keeping.
+ * @return as finishNzbParser(), or -ENOMEM if the index couldn't hold it
+ *         all. Either way, the index must be released with releaseIndex().
+ */
+int indexNzb(const void * data, size_t length, tParseFlags flags, tNzbIndex * index);
+
+#endif
@@ -0,0 +1,118 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "nzb-arena.h"
+
+/* big enough for the element stack of any sane NZB, so a document
+ * normally costs a single malloc() */
+#define kArenaBlockSize  (16 * 1024)
+
+#define kArenaAlign  alignof(max_align_t)
+
+void arenaInit(tArena * arena) {
+    memset(arena, 0, sizeof(tArena));
+}
+
+void arenaRelease(tArena * arena) {
+    tArenaBlock * block = arena->first;
+    while ( block != NULL) {
+        tArenaBlock * next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->block = NULL;
+    arena->used = 0;
+    arena->inUse = 0;
+}
+
+/**
+ * make arena->block a block with at least size bytes free, reusing blocks
+ * left over from a rewind where possible.
+ */
+static int nextBlock(tArena * arena, size_t size) {
+    tArenaBlock * next = arena->block ? arena->block->next : arena->first;
+
+    if ( next == NULL || next->size < size ) {
+        size_t blockSize = size > kArenaBlockSize ? size : kArenaBlockSize;
+        tArenaBlock * block = malloc(sizeof(tArenaBlock) + blockSize);
+        if ( block == NULL) {
+            return -1;
+        }
+        arena->stats.blocks++;
+        block->size = blockSize;
+        /* splice it in ahead of any (too small) spare block */
+        block->next = next;
+        if ( arena->block != NULL) {
+            arena->block->next = block;
+        } else {
+            arena->first = block;
+        }
+        next = block;
+    }
+
+    /* the tail of the block we're leaving is abandoned until a rewind */
+    if ( arena->block != NULL) {
+        arena->inUse += arena->block->size - arena->used;
+    }
+    arena->block = next;
+    arena->used = 0;
+    return 0;
+}
+
+static void * bump(tArena * arena, size_t size) {
+    size = (size + kArenaAlign - 1) & ~(kArenaAlign - 1);
+
+    if ( arena->block == NULL || arena->block->size - arena->used < size ) {
+        if ( nextBlock(arena, size) != 0 ) {
+            return NULL;
+        }
+    }
+
+    void * result = &arena->block->data[ arena->used ];
+    arena->used += size;
+    arena->inUse += size;
+
+    arena->stats.allocations++;
+    arena->stats.bytes += size;
+    if ( arena->inUse > arena->stats.highWater ) {
+        arena->stats.highWater = arena->inUse;
+    }
+
+    return result;
+}
+
+void * arenaAlloc(tArena * arena, size_t size) {
+    void * result = bump(arena, size);
+    if ( result != NULL) {
+        memset(result, 0, size);
+    }
+    return result;
+}
+
+char * arenaStrndup(tArena * arena, const char * string, size_t length) {
+    char * result = bump(arena, length + 1);
+    if ( result != NULL) {
+        memcpy(result, string, length);
+        result[ length ] = '\0';
+    }
+    return result;
+}
+
+tArenaMark arenaMark(const tArena * arena) {
+    tArenaMark mark = { arena->block, arena->used, arena->inUse };
+    return mark;
+}
+
+void arenaRewind(tArena * arena, tArenaMark mark) {
+    arena->block = mark.block;
+    arena->used = mark.used;
+    arena->inUse = mark.inUse;
+}
+
+void arenaReset(tArena * arena) {
+    tArenaMark empty = { NULL, 0, 0 };
+    arenaRewind(arena, empty);
+}
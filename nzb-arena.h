@@ -0,0 +1,56 @@
+
+#ifndef NZB_ARENA_H
+#define NZB_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * A bump allocator for the short-lived nodes built while parsing a document.
+ *
+ * Memory comes from a chain of large blocks, so an allocation is usually just
+ * a pointer increment. Nothing is freed individually: take a mark before
+ * allocating, and rewind to it to release everything allocated since in one
+ * go. Blocks are kept for reuse until the arena is released.
+ */
+typedef struct sArenaBlock {
+    struct sArenaBlock * next;  // the block after this one, kept around after a rewind
+    size_t size;
+    unsigned char data[];
+} tArenaBlock;
+
+typedef struct {
+    unsigned long allocations;  // calls to arenaAlloc() & co.
+    unsigned long bytes;        // total bytes handed out
+    unsigned long blocks;       // calls to malloc() for new blocks
+    size_t        highWater;    // most bytes in use at any one time
+} tArenaStats;
+
+typedef struct {
+    tArenaBlock * first;
+    tArenaBlock * block;        // the block allocations currently come from
+    size_t        used;         // bytes used in block
+    size_t        inUse;        // bytes used across all blocks
+    tArenaStats   stats;
+} tArena;
+
+typedef struct {
+    tArenaBlock * block;
+    size_t        used;
+    size_t        inUse;
+} tArenaMark;
+
+void arenaInit(tArena * arena);
+void arenaRelease(tArena * arena);
+
+/** @return size zeroed bytes, or NULL if out of memory */
+void * arenaAlloc(tArena * arena, size_t size);
+/** @return a copy of the first length bytes of string, zero-terminated */
+char * arenaStrndup(tArena * arena, const char * string, size_t length);
+
+tArenaMark arenaMark(const tArena * arena);
+/** release everything allocated since mark was taken */
+void arenaRewind(tArena * arena, tArenaMark mark);
+/** release everything */
+void arenaReset(tArena * arena);
+
+#endif
@@ -0,0 +1,160 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "yxml.h"
+#include "nzb-bench.h"
+#include "nzb-input.h"
+
+uint64_t benchNanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compareFiles(const void * a, const void * b) {
+    return strcmp(((const tCorpusFile *) a)->path, ((const tCorpusFile *) b)->path);
+}
+
+static int loadFile(tCorpus * corpus, const char * path) {
+    tInput input;
+    int error = openInput(&input, path);
+    if ( error != 0 ) {
+        return error;
+    }
+
+    if ( corpus->count == corpus->capacity ) {
+        size_t capacity = corpus->capacity == 0 ? 32 : corpus->capacity * 2;
+        tCorpusFile * grown = realloc(corpus->files, capacity * sizeof(tCorpusFile));
+        if ( grown == NULL) {
+            releaseInput(&input);
+            return ENOMEM;
+        }
+        corpus->files = grown;
+        corpus->capacity = capacity;
+    }
+
+    tCorpusFile * file = &corpus->files[ corpus->count ];
+    memset(file, 0, sizeof(tCorpusFile));
+    file->path = strdup(path);
+    file->data = malloc(input.length > 0 ? input.length : 1);
+    if ( file->path == NULL || file->data == NULL) {
+        free(file->path);
+        free(file->data);
+        releaseInput(&input);
+        return ENOMEM;
+    }
+    memcpy(file->data, input.data, input.length);
+    file->length = input.length;
+    releaseInput(&input);
+
+    corpus->count++;
+    return 0;
+}
+
+static int loadDirectory(tCorpus * corpus, const char * path) {
+    DIR * dir = opendir(path);
+    if ( dir == NULL) {
+        return errno;
+    }
+
+    int result = 0;
+    size_t first = corpus->count;
+    struct dirent * entry;
+    while ( result == 0 && (entry = readdir(dir)) != NULL) {
+        struct stat info;
+        char * filePath = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        if ( filePath == NULL) {
+            result = ENOMEM;
+            break;
+        }
+        sprintf(filePath, "%s/%s", path, entry->d_name);
+        if ( stat(filePath, &info) == 0 && S_ISREG(info.st_mode)) {
+            result = loadFile(corpus, filePath);
+        }
+        free(filePath);
+    }
+    closedir(dir);
+
+    qsort(&corpus->files[ first ], corpus->count - first, sizeof(tCorpusFile), compareFiles);
+    return result;
+}
+
+int loadCorpus(tCorpus * corpus, const char * path) {
+    struct stat info;
+    if ( stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return loadDirectory(corpus, path);
+    }
+    return loadFile(corpus, path);
+}
+
+void releaseCorpus(tCorpus * corpus) {
+    for ( size_t i = 0; i < corpus->count; i++ ) {
+        free(corpus->files[ i ].path);
+        free(corpus->files[ i ].data);
+        free(corpus->files[ i ].nanoseconds);
+    }
+    free(corpus->files);
+    memset(corpus, 0, sizeof(tCorpus));
+}
+
+int captureOutput(const tCorpusFile * file, tParseFlags flags, unsigned int splitThreads,
+                  char ** output, size_t * outputLength) {
+    *output = NULL;
+    *outputLength = 0;
+    FILE * out = open_memstream(output, outputLength);
+    if ( out == NULL) {
+        return -ENOMEM;
+    }
+
+    tDocument document = { .flags = flags, .out = out, .threads = splitThreads };
+    int result = processInput(&document, file->data, file->length);
+    releaseDocument(&document);
+    fclose(out);
+    return result;
+}
+
+int captureSubjects(tCorpusFile * file, tParseFlags flags, unsigned int splitThreads, char *** subjects) {
+    char * output;
+    size_t outputLength;
+    int result = captureOutput(file, flags, splitThreads, &output, &outputLength);
+    if ( output == NULL) {
+        return -ENOMEM;
+    }
+    if ( result < 0 && result != YXML_EEOF ) {
+        free(output);
+        return result;
+    }
+
+    /* each subject was printed as "\ns: <subject>\n" */
+    file->subjects = 0;
+    for ( const char * p = output; (p = strstr(p, "\ns: ")) != NULL; p += 4 ) {
+        file->subjects++;
+    }
+
+    if ( subjects != NULL) {
+        *subjects = calloc(file->subjects + 1, sizeof(char *));
+        if ( *subjects == NULL) {
+            free(output);
+            return -ENOMEM;
+        }
+        size_t i = 0;
+        for ( const char * p = output; (p = strstr(p, "\ns: ")) != NULL && i < file->subjects; i++ ) {
+            p += 4;
+            const char * end = strchr(p, '\n');
+            size_t length = end != NULL ? (size_t) (end - p) : strlen(p);
+            (*subjects)[ i ] = strndup(p, length);
+            if ( (*subjects)[ i ] == NULL) {
+                free(output);
+                return -ENOMEM;
+            }
+        }
+    }
+    free(output);
+    return 0;
+}
@@ -0,0 +1,57 @@
+
+#ifndef NZB_BENCH_H
+#define NZB_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nzb-subject.h"
+
+/* a file of the corpus, held in memory */
+typedef struct {
+    char     * path;
+    byte     * data;
+    size_t     length;
+    size_t     subjects;
+    uint64_t * nanoseconds;     // for the caller's timings
+} tCorpusFile;
+
+typedef struct {
+    tCorpusFile * files;
+    size_t        count;
+    size_t        capacity;
+} tCorpus;
+
+/** @return CLOCK_MONOTONIC in nanoseconds */
+uint64_t benchNanoseconds(void);
+
+/**
+ * read the file (or every regular file in the directory, in name order)
+ * into memory of the corpus' own, so timings don't include page faults
+ * on a mapping.
+ * @return 0, or the errno of the first file that couldn't be read
+ */
+int loadCorpus(tCorpus * corpus, const char * path);
+
+void releaseCorpus(tCorpus * corpus);
+
+/**
+ * process the file once, with the given flags, into memory.
+ * @param output gets everything printed, malloc()ed and zero-terminated
+ *        (or NULL if a memory stream couldn't be opened)
+ * @return processInput()'s result
+ */
+int captureOutput(const tCorpusFile * file, tParseFlags flags, unsigned int splitThreads,
+                  char ** output, size_t * outputLength);
+
+/**
+ * process the file once, with the given flags, to warm up and to capture
+ * its subjects: by what was printed for them, which works whatever engine
+ * the flags pick.
+ * @param subjects if not NULL, gets an array of zero-terminated subjects,
+ *        each malloc()ed, in file order
+ * @return 0, or a negative yxml_ret_t error
+ */
+int captureSubjects(tCorpusFile * file, tParseFlags flags, unsigned int splitThreads, char *** subjects);
+
+#endif
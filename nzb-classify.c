@@ -0,0 +1,165 @@
+
+#include <string.h>
+
+#if defined(__AVX2__) && defined(__GNUC__)
+#include <immintrin.h>
+#elif defined(__SSSE3__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+/* no pshufb: compare with each character, and leave the tables out */
+#define CLASSIFY_BY_COMPARE
+#endif
+
+#include "nzb-classify.h"
+
+#ifndef CLASSIFY_BY_COMPARE
+
+/* Each character we look for gets a bit of its own in two tables, one
+ * indexed by the low nibble of a byte and one by its high nibble. A byte
+ * is that character if and only if the bit is set in both lookups. */
+enum {
+    kBit_Nul   = 1 << 0,    // 0x00
+    kBit_Space = 1 << 1,    // 0x20
+    kBit_Dash  = 1 << 2,    // 0x2d
+    kBit_Quote = 1 << 3,    // 0x22
+    kBit_Open  = 1 << 4,    // 0x5b
+    kBit_Close = 1 << 5,    // 0x5d
+
+    kBits_Separator = kBit_Nul | kBit_Space | kBit_Dash
+};
+
+static const unsigned char lowNibble[16] = {
+    [ 0x0 ] = kBit_Nul | kBit_Space,
+    [ 0x2 ] = kBit_Quote,
+    [ 0xb ] = kBit_Open,
+    [ 0xd ] = kBit_Dash | kBit_Close
+};
+
+static const unsigned char highNibble[16] = {
+    [ 0x0 ] = kBit_Nul,
+    [ 0x2 ] = kBit_Space | kBit_Dash | kBit_Quote,
+    [ 0x5 ] = kBit_Open | kBit_Close
+};
+
+#endif
+
+#if defined(__AVX2__) && defined(__GNUC__)
+
+static void classifyFull(const unsigned char * block, tCharMasks * masks) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) lowNibble));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) highNibble));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    memset(masks, 0, sizeof(tCharMasks));
+    for ( int i = 0; i < kClassifyBlock; i += 32 ) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (block + i));
+        __m256i c = _mm256_and_si256(
+                _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble)),
+                _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+
+        uint32_t separator = ~(uint32_t) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_and_si256(c, _mm256_set1_epi8(kBits_Separator)), zero));
+        uint32_t quote = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(kBit_Quote)));
+        uint32_t open = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(kBit_Open)));
+        uint32_t close = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(kBit_Close)));
+
+        masks->separator |= (uint64_t) separator << i;
+        masks->quote |= (uint64_t) quote << i;
+        masks->open |= (uint64_t) open << i;
+        masks->close |= (uint64_t) close << i;
+    }
+}
+
+#elif defined(__SSSE3__) && defined(__GNUC__)
+
+static void classifyFull(const unsigned char * block, tCharMasks * masks) {
+    const __m128i low = _mm_loadu_si128((const __m128i *) lowNibble);
+    const __m128i high = _mm_loadu_si128((const __m128i *) highNibble);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    memset(masks, 0, sizeof(tCharMasks));
+    for ( int i = 0; i < kClassifyBlock; i += 16 ) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (block + i));
+        __m128i c = _mm_and_si128(
+                _mm_shuffle_epi8(low, _mm_and_si128(v, nibble)),
+                _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+
+        uint32_t separator = ~(uint32_t) _mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_and_si128(c, _mm_set1_epi8(kBits_Separator)), zero)) & 0xffff;
+        uint32_t quote = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(kBit_Quote)));
+        uint32_t open = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(kBit_Open)));
+        uint32_t close = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(kBit_Close)));
+
+        masks->separator |= (uint64_t) separator << i;
+        masks->quote |= (uint64_t) quote << i;
+        masks->open |= (uint64_t) open << i;
+        masks->close |= (uint64_t) close << i;
+    }
+}
+
+#elif defined(CLASSIFY_BY_COMPARE)
+
+/* there are only five characters: compare with each of them */
+static void classifyFull(const unsigned char * block, tCharMasks * masks) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i dash = _mm_set1_epi8('-');
+    const __m128i quoteChar = _mm_set1_epi8('"');
+    const __m128i openChar = _mm_set1_epi8('[');
+    const __m128i closeChar = _mm_set1_epi8(']');
+
+    memset(masks, 0, sizeof(tCharMasks));
+    for ( int i = 0; i < kClassifyBlock; i += 16 ) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (block + i));
+
+        uint32_t separator = (uint32_t) _mm_movemask_epi8(
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, space)),
+                             _mm_cmpeq_epi8(v, dash)));
+        uint32_t quote = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, quoteChar));
+        uint32_t open = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, openChar));
+        uint32_t close = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, closeChar));
+
+        masks->separator |= (uint64_t) separator << i;
+        masks->quote |= (uint64_t) quote << i;
+        masks->open |= (uint64_t) open << i;
+        masks->close |= (uint64_t) close << i;
+    }
+}
+
+#else
+
+static void classifyFull(const unsigned char * block, tCharMasks * masks) {
+    memset(masks, 0, sizeof(tCharMasks));
+    for ( int i = 0; i < kClassifyBlock; i++ ) {
+        unsigned char c = lowNibble[ block[ i ] & 0x0f ] & highNibble[ block[ i ] >> 4 ];
+        uint64_t bit = (uint64_t) 1 << i;
+
+        if ( c & kBits_Separator ) masks->separator |= bit;
+        if ( c == kBit_Quote ) masks->quote |= bit;
+        if ( c == kBit_Open ) masks->open |= bit;
+        if ( c == kBit_Close ) masks->close |= bit;
+    }
+}
+
+#endif
+
+void classifyBlock(const unsigned char * block, size_t length, tCharMasks * masks) {
+    if ( length >= kClassifyBlock ) {
+        classifyFull(block, masks);
+        return;
+    }
+
+    /* a short tail: classify a padded copy, then drop the padding's bits */
+    unsigned char padded[ kClassifyBlock ] = { 0 };
+    memcpy(padded, block, length);
+    classifyFull(padded, masks);
+
+    uint64_t valid = ((uint64_t) 1 << length) - 1;
+    masks->separator &= valid;
+    masks->quote &= valid;
+    masks->open &= valid;
+    masks->close &= valid;
+}
@@ -0,0 +1,31 @@
+
+#ifndef NZB_CLASSIFY_H
+#define NZB_CLASSIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* bytes classified per call */
+#define kClassifyBlock  64
+
+/**
+ * The characters that end a run in the subject tokenizer, one bit per
+ * byte of the block (bit 0 is the first byte).
+ */
+typedef struct {
+    uint64_t separator;     // '\0', ' ' and '-'
+    uint64_t quote;         // '"'
+    uint64_t open;          // '['
+    uint64_t close;         // ']'
+} tCharMasks;
+
+/**
+ * classify up to kClassifyBlock bytes at once, with a nibble lookup
+ * (pshufb) on SSSE3 or AVX2, a compare per character on plain SSE2,
+ * otherwise a byte at a time.
+ * @param length how many bytes of block can be read; bits for bytes
+ *        past it are left clear
+ */
+void classifyBlock(const unsigned char * block, size_t length, tCharMasks * masks);
+
+#endif
@@ -0,0 +1,495 @@
+
+/*
+ * Generates a synthetic NZB of a given size, for measuring how the parser
+ * scales: memory growth and throughput on documents far bigger than the
+ * samples. Subjects, message-ids, posters and groups are taken from real
+ * NZBs (samples/ by default) and mutated; files take turns through the
+ * subject families, so every family is covered. The same seed and options
+ * always give the same document.
+ *
+ *   nzb-corpus-gen [-s size] [-r seed] [-S segments] [-L length] [-o out.nzb] [samples/ | file.nzb ...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "nzb-subject.h"
+#include "nzb-family.h"
+#include "nzb-scan.h"
+#include "nzb-bench.h"
+
+#define kDefaultSize      (1024 * 1024)
+#define kDefaultSegments  1000
+#define kDefaultCorpus    "samples"
+
+/* how much of each kind of thing to keep from the corpus */
+#define kMaxHarvest       4096
+
+/* tries at mutating a subject without it changing family */
+#define kMutateTries      8
+
+/* used for a family the corpus has no subjects for */
+static const char * builtinSubjects[ kFamilyMax ] = {
+    [kFamily_Generic] = "[ You.Cant.Turn.That.Into.A.House.S01E01.720p.FYI.WEB-DL.AAC2.0.H.264-BOOP ] - "
+                        "\"You.Cant.Turn.That.Into.A.House.S01E01.Industrial.Storage.Tank.720p.FYI.WEB-DL.AAC2.0.H.264-BOOP.part01.rar\" yEnc (01/66)",
+    [kFamily_Quoted]  = "\"what.on.earth.s07e01.nazi.doomsday.forest.1080p.web.x264-caffeine.vol007-015.par2\" yEnc (01/17)",
+    [kFamily_Hash]    = "5e0c74c3d8a34c5080cbc4834b3d392c [1/40] \"5e0c74c3d8a34c5080cbc4834b3d392c.par2\" yEnc (1/1)",
+    [kFamily_Counter] = "[01/57] - \"9ciQK4R3mMmKGyhEXWTqlj.par2\" yEnc (1/1) 51264",
+    [kFamily_Private] = "[PRiVATE]-[WtFnZb]-[Underground.Marvels.S01E01.Secrets.of.the.Rock.720p.WEBRip.x264-CAFFEiNE.mkv]-[1/7] - \"\" yEnc  1022215424 (1/1997)",
+    [kFamily_N3wZ]    = "[N3wZ] \\bdIcha192688\\::[PRiVATE]-[WtFnZb]-[4]-[1/Chuck.S02E01.Chuck.Versus.the.First.Date.REPACK.1080p.BluRay.REMUX.VC-1.DD5.1-EPSiLON.mkv] - \"\" "
+                        "yEnc (1/[PRiVATE] \\2ad4205f2d\\::ec1ad90d6f098c.ab185e364cea90e285f350352733d6.fcdf2877::/bec21662f1e5/) 1 (1/0) (1/0)",
+    [kFamily_Indexer] = "[145943]-[FULL]-[#a.b.teevee]-[ FantomWorks.S01E01.1963.Corvette.and.1931.Model.A.Hot.Rod.720p.HDTV.x264-DHD ]-[01/44] - "
+                        "\"fantomworks.s01e01.1963.corvette.and.1931.model.a.hot.rod.720p.hdtv.x264-dhd-sample.mkv\" yEnc (1/43)"
+};
+
+/* a growable list of strings */
+typedef struct {
+    char ** items;
+    size_t  count;
+    size_t  capacity;
+} tList;
+
+/* what was taken from the corpus */
+typedef struct {
+    tList         subjects[ kFamilyMax ];
+    tList         messageIds;
+    tList         posters;
+    tList         groups;
+    unsigned long segmentBytes[ kMaxHarvest ];
+    size_t        segmentBytesCount;
+} tHarvest;
+
+static const char * myName;
+
+static void outOfMemory(void) {
+    fprintf(stderr, "### %s: error: out of memory\n", myName);
+    exit(-ENOMEM);
+}
+
+/** splitmix64: small, fast, and the same everywhere */
+static uint64_t nextRandom(uint64_t * state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/** @return a random number in [0, bound) */
+static size_t randomBelow(uint64_t * state, size_t bound) {
+    return bound > 0 ? (size_t) (nextRandom(state) % bound) : 0;
+}
+
+static void addItem(tList * list, const char * start, size_t length) {
+    if ( list->count >= kMaxHarvest ) {
+        return;
+    }
+    if ( list->count == list->capacity ) {
+        list->capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        list->items = realloc(list->items, list->capacity * sizeof(char *));
+        if ( list->items == NULL) {
+            outOfMemory();
+        }
+    }
+    list->items[ list->count ] = strndup(start, length);
+    if ( list->items[ list->count ] == NULL) {
+        outOfMemory();
+    }
+    list->count++;
+}
+
+static void releaseList(tList * list) {
+    for ( size_t i = 0; i < list->count; i++ ) {
+        free(list->items[ i ]);
+    }
+    free(list->items);
+}
+
+/**
+ * find each '<open' ... '>text</close>' in the data, handing text (still
+ * escaped) to the list.
+ * @param plain only take text without entities, so it can be scrambled
+ */
+static void harvestElements(tList * list, const tCorpusFile * file, const char * open, const char * close, bool plain) {
+    const byte * p = file->data;
+    const byte * end = p + file->length;
+    size_t openLength = strlen(open);
+    size_t closeLength = strlen(close);
+
+    while ( list->count < kMaxHarvest && (p = findString(p, end, open, openLength)) != NULL) {
+        const byte * text = memchr(p, '>', end - p);
+        if ( text == NULL) {
+            break;
+        }
+        text++;
+        const byte * stop = findString(text, end, close, closeLength);
+        if ( stop == NULL) {
+            break;
+        }
+        if ( stop > text && !(plain && memchr(text, '&', stop - text) != NULL)) {
+            addItem(list, (const char *) text, stop - text);
+        }
+        p = stop + closeLength;
+    }
+}
+
+/** find each name="value" attribute, handing value (still escaped) to the list */
+static void harvestAttributes(tList * list, const tCorpusFile * file, const char * name) {
+    const byte * p = file->data;
+    const byte * end = p + file->length;
+    size_t nameLength = strlen(name);
+
+    while ( list->count < kMaxHarvest && (p = findString(p, end, name, nameLength)) != NULL) {
+        p += nameLength;
+        const byte * stop = memchr(p, '"', end - p);
+        if ( stop == NULL) {
+            break;
+        }
+        addItem(list, (const char *) p, stop - p);
+        p = stop + 1;
+    }
+}
+
+static void harvestSegmentBytes(tHarvest * harvest, const tCorpusFile * file) {
+    const byte * p = file->data;
+    const byte * end = p + file->length;
+
+    while ( harvest->segmentBytesCount < kMaxHarvest && (p = findString(p, end, "<segment bytes=\"", 16)) != NULL) {
+        p += 16;
+        unsigned long bytes = strtoul((const char *) p, NULL, 10);
+        if ( bytes > 0 ) {
+            harvest->segmentBytes[ harvest->segmentBytesCount++ ] = bytes;
+        }
+    }
+}
+
+static void harvestCorpus(tHarvest * harvest, tCorpus * corpus) {
+    for ( size_t f = 0; f < corpus->count; f++ ) {
+        tCorpusFile * file = &corpus->files[ f ];
+        char ** subjects;
+
+        int result = captureSubjects(file, kParse_Default, 1, &subjects);
+        if ( result < 0 ) {
+            fprintf(stderr, "### %s: error: unable to process \'%s\' (%d)\n", myName, file->path, result);
+            exit(result);
+        }
+        for ( size_t i = 0; i < file->subjects; i++ ) {
+            const byte * subject = (const byte *) subjects[ i ];
+            size_t length = strlen(subjects[ i ]);
+            tSubjectFamily family = classifyFamily(subject, trimSubject(subject, length));
+            addItem(&harvest->subjects[ family ], subjects[ i ], length);
+            free(subjects[ i ]);
+        }
+        free(subjects);
+
+        harvestElements(&harvest->messageIds, file, "<segment ", "</segment>", true);
+        harvestElements(&harvest->groups, file, "<group>", "</group>", false);
+        harvestAttributes(&harvest->posters, file, "poster=\"");
+        harvestSegmentBytes(harvest, file);
+    }
+
+    for ( int family = 0; family < kFamilyMax; family++ ) {
+        if ( harvest->subjects[ family ].count == 0 ) {
+            addItem(&harvest->subjects[ family ], builtinSubjects[ family ], strlen(builtinSubjects[ family ]));
+        }
+    }
+    if ( harvest->messageIds.count == 0 ) {
+        addItem(&harvest->messageIds, "DLcXFLWKnJzRgjnfFjUkPDXS@k5mucjdY1TUp.A69", 41);
+    }
+    if ( harvest->groups.count == 0 ) {
+        addItem(&harvest->groups, "alt.binaries.misc", 17);
+    }
+    if ( harvest->posters.count == 0 ) {
+        addItem(&harvest->posters, "7cc92@648075182f.com", 20);
+    }
+    if ( harvest->segmentBytesCount == 0 ) {
+        harvest->segmentBytes[ harvest->segmentBytesCount++ ] = 739666;
+    }
+}
+
+/* words that shape a subject, so are left as they are */
+static const char * keywords[] = { "yEnc", "PRiVATE", "WtFnZb", "N3wZ", "newzNZB", "FULL", "of", NULL };
+
+/**
+ * replace letters and digits with random ones of the same kind, at the
+ * given rate (1 in n).
+ * @param keep if not NULL, the characters to leave alone
+ */
+static void scramble(char * text, size_t length, uint64_t * random, unsigned int rate, const bool * keep) {
+    for ( size_t i = 0; i < length; i++ ) {
+        unsigned char c = (unsigned char) text[ i ];
+        if ( !isalnum(c) || (keep != NULL && keep[ i ]) || randomBelow(random, rate) != 0 ) {
+            continue;
+        }
+        if ( isdigit(c)) {
+            text[ i ] = (char) ('0' + randomBelow(random, 10));
+        } else if ( isupper(c)) {
+            text[ i ] = (char) ('A' + randomBelow(random, 26));
+        } else {
+            text[ i ] = (char) ('a' + randomBelow(random, 26));
+        }
+    }
+}
+
+/**
+ * a variation on the subject: digits and letters changed here and there,
+ * and, if longer is more than its length, stretched to that length by
+ * growing its longest run of letters, digits and dots.
+ * @return a malloc()ed subject of the same family
+ */
+static char * mutateSubject(const char * subject, tSubjectFamily family, size_t longer, uint64_t * random) {
+    size_t length = strlen(subject);
+    size_t size = (longer > length ? longer : length) + 1;
+    char * result = malloc(size);
+    if ( result == NULL) {
+        outOfMemory();
+    }
+
+    bool * keep = calloc(length + 1, sizeof(bool));
+    if ( keep == NULL) {
+        outOfMemory();
+    }
+    for ( const char ** keyword = keywords; *keyword != NULL; keyword++ ) {
+        size_t keywordLength = strlen(*keyword);
+        for ( const char * p = subject; (p = strstr(p, *keyword)) != NULL; p += keywordLength ) {
+            memset(&keep[ p - subject ], true, keywordLength);
+        }
+    }
+
+    for ( int attempt = 0; attempt < kMutateTries; attempt++ ) {
+        memcpy(result, subject, length + 1);
+        scramble(result, length, random, 4, keep);
+
+        if ( longer > length ) {
+            size_t bestStart = 0;
+            size_t bestLength = 0;
+            for ( size_t i = 0; i < length; ) {
+                size_t start = i;
+                while ( i < length && (isalnum((unsigned char) result[ i ]) || result[ i ] == '.')) i++;
+                if ( i - start > bestLength ) {
+                    bestStart = start;
+                    bestLength = i - start;
+                }
+                if ( i == start ) i++;
+            }
+            size_t extra = longer - length;
+            size_t at = bestStart + bestLength;
+            memmove(&result[ at + extra ], &result[ at ], length - at + 1);
+            for ( size_t i = 0; i < extra; i++ ) {
+                result[ at + i ] = (i % 8 == 7) ? '.' : (char) ('a' + randomBelow(random, 26));
+            }
+        }
+
+        size_t resultLength = strlen(result);
+        if ( classifyFamily((const byte *) result, trimSubject((const byte *) result, resultLength)) == family ) {
+            free(keep);
+            return result;
+        }
+    }
+    /* couldn't keep it in the family, so use it as it was */
+    memcpy(result, subject, length + 1);
+    free(keep);
+    return result;
+}
+
+/** @return how many bytes were written */
+static size_t writeEscaped(FILE * out, const char * text) {
+    size_t written = 0;
+    for ( const char * p = text; *p != '\0'; p++ ) {
+        switch ( *p ) {
+        case '&':  written += fwrite("&amp;", 1, 5, out); break;
+        case '<':  written += fwrite("&lt;", 1, 4, out); break;
+        case '>':  written += fwrite("&gt;", 1, 4, out); break;
+        case '"':  written += fwrite("&quot;", 1, 6, out); break;
+        default:
+            putc(*p, out);
+            written++;
+            break;
+        }
+    }
+    return written;
+}
+
+static size_t parseSize(const char * text) {
+    char * suffix;
+    unsigned long long size = strtoull(text, &suffix, 10);
+    switch ( toupper((unsigned char) *suffix)) {
+    case 'G': size *= 1024;     /* fall through */
+    case 'M': size *= 1024;     /* fall through */
+    case 'K': size *= 1024;     break;
+    case '\0': break;
+    default:  return 0;
+    }
+    return (size_t) size;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: %s [-s size] [-r seed] [-S segments] [-L length] [-o out.nzb] [directory | file.nzb ...]\n"
+            "  -s  roughly how big an NZB to make, e.g. 1M or 4G (default 1M)\n"
+            "  -r  seed for the variations (default 1)\n"
+            "  -S  most segments per file (default %d)\n"
+            "  -L  stretch every subject to at least this many bytes\n"
+            "  -o  where to write it (default stdout)\n"
+            "subjects and segments are taken from the files in %s/ unless others are given\n",
+            myName, kDefaultSegments, kDefaultCorpus);
+}
+
+int main(int argc, char * const argv[]) {
+    myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    size_t target = kDefaultSize;
+    uint64_t random = 1;
+    size_t maxSegments = kDefaultSegments;
+    size_t longer = 0;
+    const char * outPath = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "L:o:r:s:S:")) != -1) {
+        switch ( opt ) {
+        case 'L':
+            longer = strtoul(optarg, NULL, 10);
+            break;
+
+        case 'o':
+            outPath = optarg;
+            break;
+
+        case 'r':
+            random = strtoull(optarg, NULL, 10);
+            break;
+
+        case 's':
+            target = parseSize(optarg);
+            if ( target == 0 ) {
+                usage();
+                exit(EINVAL);
+            }
+            break;
+
+        case 'S':
+            maxSegments = strtoul(optarg, NULL, 10);
+            if ( maxSegments == 0 ) {
+                usage();
+                exit(EINVAL);
+            }
+            break;
+
+        default:
+            usage();
+            exit(EINVAL);
+        }
+    }
+
+    tCorpus corpus = { NULL, 0, 0 };
+    const char * const * paths = (const char * const *) &argv[ optind ];
+    int pathCount = argc - optind;
+    const char * defaultPath = kDefaultCorpus;
+    if ( pathCount == 0 ) {
+        paths = &defaultPath;
+        pathCount = 1;
+    }
+    for ( int i = 0; i < pathCount; i++ ) {
+        int error = loadCorpus(&corpus, paths[ i ]);
+        if ( error != 0 ) {
+            fprintf(stderr, "### %s: error: unable to load \'%s\' (%d: %s)\n",
+                    myName, paths[ i ], error, strerror(error));
+            exit(-error);
+        }
+    }
+
+    tHarvest harvest;
+    memset(&harvest, 0, sizeof(harvest));
+    harvestCorpus(&harvest, &corpus);
+    releaseCorpus(&corpus);
+
+    FILE * out = stdout;
+    if ( outPath != NULL) {
+        out = fopen(outPath, "w");
+        if ( out == NULL) {
+            fprintf(stderr, "### %s: error: unable to write \'%s\' (%d: %s)\n",
+                    myName, outPath, errno, strerror(errno));
+            exit(-errno);
+        }
+    }
+    setvbuf(out, NULL, _IOFBF, 1024 * 1024);
+
+    static const char header[] =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<!DOCTYPE nzb PUBLIC \"-//newzBin//DTD NZB 1.1//EN\" \"http://www.newzbin.com/DTD/nzb/nzb-1.1.dtd\">\n"
+            "<nzb xmlns=\"http://www.newzbin.com/DTD/2003/nzb\">\n";
+    static const char footer[] = "</nzb>\n";
+
+    size_t written = fwrite(header, 1, sizeof(header) - 1, out);
+    size_t files = 0;
+    size_t segments = 0;
+    size_t familyFiles[ kFamilyMax ] = { 0 };
+    unsigned long date = 1598976132;
+
+    while ( written + sizeof(footer) - 1 < target ) {
+        /* take turns through the families */
+        tSubjectFamily family = (tSubjectFamily) (files % kFamilyMax);
+        const tList * subjects = &harvest.subjects[ family ];
+        char * subject = mutateSubject(subjects->items[ randomBelow(&random, subjects->count) ], family, longer, &random);
+
+        written += fprintf(out, "<file poster=\"%s\" date=\"%lu\" subject=\"",
+                           harvest.posters.items[ randomBelow(&random, harvest.posters.count) ], date + files);
+        written += writeEscaped(out, subject);
+        written += fprintf(out, "\">\n <groups>\n  <group>%s</group>\n </groups>\n <segments>\n",
+                           harvest.groups.items[ randomBelow(&random, harvest.groups.count) ]);
+        free(subject);
+
+        size_t count = 1 + randomBelow(&random, maxSegments);
+        for ( size_t s = 1; s <= count; s++ ) {
+            char * id = strdup(harvest.messageIds.items[ randomBelow(&random, harvest.messageIds.count) ]);
+            if ( id == NULL) {
+                outOfMemory();
+            }
+            scramble(id, strlen(id), &random, 1, NULL);
+            unsigned long bytes = harvest.segmentBytes[ randomBelow(&random, harvest.segmentBytesCount) ];
+            bytes += randomBelow(&random, 512);
+            written += fprintf(out, "  <segment bytes=\"%lu\" number=\"%zu\">%s</segment>\n", bytes, s, id);
+            free(id);
+
+            if ( written + sizeof(footer) - 1 >= target ) {
+                count = s;
+                break;
+            }
+        }
+        written += fprintf(out, " </segments>\n</file>\n");
+
+        segments += count;
+        familyFiles[ family ]++;
+        files++;
+    }
+    written += fwrite(footer, 1, sizeof(footer) - 1, out);
+
+    if ( fflush(out) != 0 || ferror(out)) {
+        fprintf(stderr, "### %s: error: unable to write the NZB (%d: %s)\n", myName, errno, strerror(errno));
+        exit(-errno);
+    }
+    if ( out != stdout ) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%zu bytes, %zu files, %zu segments:", written, files, segments);
+    for ( int family = 0; family < kFamilyMax; family++ ) {
+        fprintf(stderr, " %s %zu", describeFamily((tSubjectFamily) family), familyFiles[ family ]);
+    }
+    fprintf(stderr, "\n");
+
+    for ( int family = 0; family < kFamilyMax; family++ ) {
+        releaseList(&harvest.subjects[ family ]);
+    }
+    releaseList(&harvest.messageIds);
+    releaseList(&harvest.posters);
+    releaseList(&harvest.groups);
+    return 0;
+}
@@ -0,0 +1,485 @@
+
+/*
+ * Checks that a fast engine agrees with the reference one: every file of
+ * the corpus is processed twice, once by the reference path (yxml fed a
+ * byte at a time, the generic tokenizer) and once with the flags given,
+ * both with kParse_Results so each subject is followed by the counter and
+ * filename made of it. With -T, the tokens are compared as well: they're
+ * what the filename and counter are picked from, so an engine can get
+ * those right and still tokenize differently. The two are compared subject
+ * by subject, and the first subject of each file where they part ways is
+ * reported.
+ *
+ * With -F, it's what an embedder gets that's compared instead: each file is
+ * parsed through nzb-api.h by the reference and by the default path, into a
+ * line for each <file> (as nzb-subject -F prints) and a dump of the index of
+ * it, message-ids and all. The default path is fed the file whole, and then
+ * in pieces of every size in feedSizes, and the first line of each that
+ * differs from the reference is reported.
+ *
+ *   nzb-diff [-efpstT] [-J threads] [samples/ | file.nzb ...]
+ *   nzb-diff -F [-efst] [samples/ | file.nzb ...]
+ *
+ * Exits with 0 if every file agrees, 1 if any doesn't.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "nzb-subject.h"
+#include "nzb-api.h"
+#include "nzb-bench.h"
+
+#define kDefaultCorpus  "samples"
+
+#define kReferenceFlags  (kParse_ByteWise | kParse_Results)
+
+/* a subject, and what was made of it, as printed */
+typedef struct {
+    const char * subject;
+    const char * result;
+    const char * tokens;        // "" unless kParse_Tokens
+} tRecord;
+
+typedef struct {
+    char    * output;
+    size_t    outputLength;
+    int       status;           // processInput()'s result
+    tRecord * records;
+    size_t    count;
+} tRun;
+
+static const char * myName;
+
+static void outOfMemory(void) {
+    fprintf(stderr, "### %s: error: out of memory\n", myName);
+    exit(-ENOMEM);
+}
+
+/**
+ * split the output into lines, in place, and pair each "s: " line with
+ * the "r: " and "t: " lines after it. Anything else (debug logging) is skipped.
+ */
+static void collectRecords(tRun * run) {
+    size_t capacity = 0;
+    tRecord * record = NULL;
+
+    for ( char * line = run->output; line < run->output + run->outputLength; ) {
+        char * end = strchr(line, '\n');
+        if ( end != NULL) {
+            *end = '\0';
+        }
+
+        if ( strncmp(line, "s: ", 3) == 0 ) {
+            if ( run->count == capacity ) {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+                run->records = realloc(run->records, capacity * sizeof(tRecord));
+                if ( run->records == NULL) {
+                    outOfMemory();
+                }
+            }
+            record = &run->records[ run->count++ ];
+            record->subject = line + 3;
+            record->result = "(none)";
+            record->tokens = "";
+        } else if ( strncmp(line, "r: ", 3) == 0 && record != NULL) {
+            record->result = line + 3;
+        } else if ( strncmp(line, "t: ", 3) == 0 && record != NULL) {
+            record->tokens = line + 3;
+            record = NULL;
+        }
+
+        if ( end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+}
+
+static void runEngine(tRun * run, const tCorpusFile * file, tParseFlags flags, unsigned int splitThreads) {
+    memset(run, 0, sizeof(tRun));
+    run->status = captureOutput(file, flags, splitThreads, &run->output, &run->outputLength);
+    if ( run->output == NULL) {
+        outOfMemory();
+    }
+    collectRecords(run);
+}
+
+static void releaseRun(tRun * run) {
+    free(run->output);
+    free(run->records);
+}
+
+/**
+ * compare the two runs of a file, reporting where they first differ.
+ * @return true if they agree
+ */
+static bool compareRuns(const char * path, const tRun * reference, const tRun * candidate) {
+    if ( (reference->status < 0) != (candidate->status < 0) ) {
+        printf("%s: reference returned %d, candidate %d\n", path, reference->status, candidate->status);
+        return false;
+    }
+
+    size_t count = reference->count < candidate->count ? reference->count : candidate->count;
+    for ( size_t i = 0; i < count; i++ ) {
+        const tRecord * expected = &reference->records[ i ];
+        const tRecord * actual = &candidate->records[ i ];
+        if ( strcmp(expected->subject, actual->subject) != 0 || strcmp(expected->result, actual->result) != 0
+             || strcmp(expected->tokens, actual->tokens) != 0 ) {
+            printf("%s: subject %zu differs\n", path, i + 1);
+            printf("  reference: %s\n             %s\n", expected->subject, expected->result);
+            if ( *expected->tokens != '\0' ) {
+                printf("             %s\n", expected->tokens);
+            }
+            printf("  candidate: %s\n             %s\n", actual->subject, actual->result);
+            if ( *actual->tokens != '\0' ) {
+                printf("             %s\n", actual->tokens);
+            }
+            return false;
+        }
+    }
+
+    if ( reference->count != candidate->count ) {
+        const tRun * longer = reference->count > candidate->count ? reference : candidate;
+        printf("%s: reference has %zu subjects, candidate %zu; the first extra is\n  %s: %s\n             %s\n",
+               path, reference->count, candidate->count, longer == reference ? "reference" : "candidate",
+               longer->records[ count ].subject, longer->records[ count ].result);
+        return false;
+    }
+    return true;
+}
+
+/* what -F compares: all that was printed of a parse, and the lines of it */
+typedef struct {
+    char         * output;
+    size_t         outputLength;
+    FILE         * out;
+    const char  ** lines;
+    size_t         count;
+} tText;
+
+/*
+ * The pieces -F feeds a file in, after feeding it whole: every way a tag, an
+ * entity or a </segment> can be cut, and then some more like what a read()
+ * returns.
+ */
+static const size_t feedSizes[] = { 1, 2, 3, 5, 7, 16, 61, 509, 4096 };
+
+static void openText(tText * text) {
+    memset(text, 0, sizeof(tText));
+    text->out = open_memstream(&text->output, &text->outputLength);
+    if ( text->out == NULL) {
+        outOfMemory();
+    }
+}
+
+/** stop printing to the text, and split it into lines, in place */
+static void closeText(tText * text) {
+    fclose(text->out);
+    text->out = NULL;
+
+    size_t capacity = 0;
+    for ( char * line = text->output; line < text->output + text->outputLength; ) {
+        char * end = strchr(line, '\n');
+        if ( end != NULL) {
+            *end = '\0';
+        }
+        if ( text->count == capacity ) {
+            capacity = capacity == 0 ? 256 : capacity * 2;
+            text->lines = realloc(text->lines, capacity * sizeof(const char *));
+            if ( text->lines == NULL) {
+                outOfMemory();
+            }
+        }
+        text->lines[ text->count++ ] = line;
+
+        if ( end == NULL) {
+            break;
+        }
+        line = end + 1;
+    }
+}
+
+static void releaseText(tText * text) {
+    free(text->output);
+    free(text->lines);
+}
+
+/** onFile callback: a line with everything in the file's tFileResult */
+static void printFile(void * context, const tFileResult * file) {
+    fprintf(context, "f: %u/%u %s%s, part %u/%u, %u segments, %" PRIu64 " bytes \"%.*s\" in \"%.*s\" of \"%.*s\"\n",
+            file->index, file->total, describeFamily(file->family), file->confident ? ", confident" : "",
+            file->part, file->parts, file->segments, file->bytes,
+            (int) file->filename.length, file->subject + file->filename.offset,
+            (int) file->directory.length, file->subject + file->directory.offset,
+            (int) file->length, file->subject);
+}
+
+/** a line for the index, and then one for each of its groups, files and segments */
+static void printIndex(FILE * out, const tNzbIndex * index) {
+    fprintf(out, "i: %zu files, %zu segments, %zu groups%s\n",
+            index->fileCount, index->segmentCount, index->groupCount, index->failed ? ", failed" : "");
+    for ( size_t g = 0; g < index->groupCount; g++ ) {
+        fprintf(out, "g: %s\n", indexString(index, index->group[ g ]));
+    }
+    for ( size_t i = 0; i < index->fileCount; i++ ) {
+        fprintf(out, "f: \"%s\" named \"%s\", groups %016" PRIx64 "\n",
+                indexString(index, index->subject[ i ]), indexString(index, index->name[ i ]), index->groups[ i ]);
+        for ( size_t s = index->firstSegment[ i ]; s < index->firstSegment[ i + 1 ]; s++ ) {
+            char messageId[ 1024 ];
+            size_t length = indexMessageId(index, s, messageId, sizeof(messageId));
+            fprintf(out, "s: %" PRIu32 ", %" PRIu32 " bytes, %zu: <%s>\n",
+                    index->number[ s ], index->bytes[ s ], length, messageId);
+        }
+    }
+}
+
+/**
+ * parse the file with a tNzbParser, printing each <file> as it's reported.
+ * @param feedSize how much to feed it at a time, 0 for all at once
+ */
+static void captureFiles(tText * text, const tCorpusFile * file, tParseFlags flags, size_t feedSize) {
+    openText(text);
+    tNzbParser * parser = createNzbParser(flags, printFile, text->out);
+    if ( parser == NULL) {
+        outOfMemory();
+    }
+    size_t step = feedSize == 0 ? file->length : feedSize;
+    for ( size_t at = 0; at < file->length; at += step ) {
+        feedNzbParser(parser, file->data + at, file->length - at < step ? file->length - at : step);
+    }
+    fprintf(text->out, "result: %d\n", finishNzbParser(parser));
+    closeText(text);
+}
+
+/**
+ * parse the file into an index, the way indexNzb() does but a piece at a
+ * time, and print all of the index.
+ */
+static void captureIndex(tText * text, const tCorpusFile * file, tParseFlags flags, size_t feedSize) {
+    tNzbIndex index;
+    initIndex(&index);
+    tDocument document = { .flags = flags, .threads = 1, .index = &index };
+    tParser * parser = createParser(&document);
+    if ( parser == NULL) {
+        outOfMemory();
+    }
+    size_t step = feedSize == 0 ? file->length : feedSize;
+    for ( size_t at = 0; at < file->length; at += step ) {
+        feedParser(parser, file->data + at, file->length - at < step ? file->length - at : step);
+    }
+    int result = finishParser(parser);
+    releaseDocument(&document);
+    trimIndex(&index);
+
+    openText(text);
+    fprintf(text->out, "result: %d\n", result);
+    printIndex(text->out, &index);
+    closeText(text);
+    releaseIndex(&index);
+}
+
+/**
+ * compare what the reference and the candidate made of a file, reporting
+ * the first line where they differ.
+ * @return true if they agree
+ */
+static bool compareTexts(const char * path, const char * what, size_t feedSize,
+                         const tText * reference, const tText * candidate) {
+    size_t count = reference->count < candidate->count ? reference->count : candidate->count;
+    size_t i = 0;
+    while ( i < count && strcmp(reference->lines[ i ], candidate->lines[ i ]) == 0 ) {
+        i++;
+    }
+    if ( i == count && reference->count == candidate->count ) {
+        return true;
+    }
+
+    if ( feedSize == 0 ) {
+        printf("%s: %s, fed whole, differ at line %zu\n", path, what, i + 1);
+    } else {
+        printf("%s: %s, fed %zu bytes at a time, differ at line %zu\n", path, what, feedSize, i + 1);
+    }
+    printf("  reference: %s\n", i < reference->count ? reference->lines[ i ] : "(the end)");
+    printf("  candidate: %s\n", i < candidate->count ? candidate->lines[ i ] : "(the end)");
+    return false;
+}
+
+/**
+ * compare the files and the index of the file, fed whole and in each of
+ * feedSizes, with the reference's, stopping at the first difference.
+ * @return true if they all agree
+ */
+static bool compareStructure(const tCorpusFile * file, tParseFlags referenceFlags, tParseFlags flags, size_t * fileCount) {
+    tText referenceFiles;
+    tText referenceIndex;
+    captureFiles(&referenceFiles, file, referenceFlags, 0);
+    captureIndex(&referenceIndex, file, referenceFlags, 0);
+    *fileCount = 0;
+    for ( size_t i = 0; i < referenceFiles.count; i++ ) {
+        if ( strncmp(referenceFiles.lines[ i ], "f: ", 3) == 0 ) {
+            (*fileCount)++;
+        }
+    }
+
+    bool agree = true;
+    for ( size_t f = 0; agree && f <= sizeof(feedSizes) / sizeof(feedSizes[ 0 ]); f++ ) {
+        size_t feedSize = f == 0 ? 0 : feedSizes[ f - 1 ];
+        tText files;
+        tText index;
+        captureFiles(&files, file, flags, feedSize);
+        captureIndex(&index, file, flags, feedSize);
+        agree = compareTexts(file->path, "the files", feedSize, &referenceFiles, &files)
+                && compareTexts(file->path, "the index", feedSize, &referenceIndex, &index);
+        releaseText(&files);
+        releaseText(&index);
+    }
+
+    releaseText(&referenceFiles);
+    releaseText(&referenceIndex);
+    return agree;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: %s [-efpstT] [-J threads] [directory | file.nzb ...]\n"
+            "       %s -F [-efst] [directory | file.nzb ...]\n"
+            "  -e -f -p -s -t -J  as for nzb-subject: the engine to check against the reference\n"
+            "  -T  compare the tokens of each subject too\n"
+            "  -F  compare the files and the index made of each NZB, fed whole and in pieces, instead\n"
+            "the corpus defaults to the files in %s/\n",
+            myName, myName, kDefaultCorpus);
+}
+
+int main(int argc, char * const argv[]) {
+    myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    tParseFlags flags = kParse_Results;
+    tParseFlags referenceFlags = kReferenceFlags;
+    int splitThreads = 1;
+    bool structure = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "efFJ:pstT")) != -1) {
+        switch ( opt ) {
+        case 'e':
+            flags |= kParse_EarlyExit;
+            break;
+
+        case 'F':
+            structure = true;
+            break;
+
+        case 'f':
+            flags |= kParse_Families;
+            break;
+
+        case 'J':
+            splitThreads = atoi(optarg);
+            if ( splitThreads < 0 ) {
+                usage();
+                exit(EINVAL);
+            }
+            if ( splitThreads != 1 ) {
+                flags |= kParse_Split;
+            }
+            break;
+
+        case 'p':
+            flags |= kParse_Prefilter;
+            break;
+
+        case 's':
+            flags |= kParse_SubjectsOnly;
+            break;
+
+        case 't':
+            flags |= kParse_Templates;
+            break;
+
+        case 'T':
+            flags |= kParse_Tokens;
+            referenceFlags |= kParse_Tokens;
+            break;
+
+        default:
+            usage();
+            exit(EINVAL);
+        }
+    }
+
+    if ( structure ) {
+        /* nzb-api.h takes none of the whole-document engines, or the tokens */
+        if ( (flags & (kParse_Prefilter | kParse_Split | kParse_Tokens)) != 0 ) {
+            usage();
+            exit(EINVAL);
+        }
+        referenceFlags = kParse_ByteWise | (flags & kParse_SubjectsOnly);
+        flags &= kParse_SubjectsOnly | kParse_Templates | kParse_Families | kParse_EarlyExit;
+    }
+
+    const char * const * paths = (const char * const *) &argv[ optind ];
+    int pathCount = argc - optind;
+    const char * defaultPath = kDefaultCorpus;
+    if ( pathCount == 0 ) {
+        paths = &defaultPath;
+        pathCount = 1;
+    }
+
+    size_t files = 0;
+    size_t subjects = 0;
+    size_t differing = 0;
+    for ( int p = 0; p < pathCount; p++ ) {
+        /* a path at a time, so only one of several generated corpora is held at once */
+        tCorpus corpus = { NULL, 0, 0 };
+        int error = loadCorpus(&corpus, paths[ p ]);
+        if ( error != 0 ) {
+            fprintf(stderr, "### %s: error: unable to load \'%s\' (%d: %s)\n",
+                    myName, paths[ p ], error, strerror(error));
+            exit(-error);
+        }
+
+        for ( size_t i = 0; i < corpus.count; i++ ) {
+            const tCorpusFile * file = &corpus.files[ i ];
+            if ( structure ) {
+                size_t fileCount;
+                if ( !compareStructure(file, referenceFlags, flags, &fileCount) ) {
+                    differing++;
+                }
+                files++;
+                subjects += fileCount;
+                continue;
+            }
+
+            tRun reference;
+            tRun candidate;
+            runEngine(&reference, file, referenceFlags, 1);
+            runEngine(&candidate, file, flags, (unsigned int) splitThreads);
+
+            if ( !compareRuns(file->path, &reference, &candidate) ) {
+                differing++;
+            }
+            files++;
+            subjects += reference.count;
+
+            releaseRun(&reference);
+            releaseRun(&candidate);
+        }
+        releaseCorpus(&corpus);
+    }
+
+    printf("%zu files, %zu %s: ", files, subjects, structure ? "<file>s" : "subjects");
+    if ( differing == 0 ) {
+        printf("all agree\n");
+    } else {
+        printf("%zu files differ\n", differing);
+    }
+    return differing == 0 ? 0 : 1;
+}
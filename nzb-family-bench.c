@@ -0,0 +1,198 @@
+
+/*
+ * Times the subject family parsers against the generic tokenizer, family by
+ * family, over a list of subjects (one per line), e.g. those of the samples:
+ *
+ *   nzb-subject -s samples/<name>.nzb ... | sed -n 's/^s: //p' > subjects.txt
+ *   nzb-family-bench subjects.txt
+ *
+ * It also checks every subject a family parser takes gives the same tokens
+ * as the tokenizer.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nzb-subject.h"
+#include "nzb-family.h"
+
+#define kDefaultRounds  1000
+
+typedef struct {
+    const byte   * text;
+    size_t         length;      // trimmed
+    tSubjectFamily family;
+} tSample;
+
+typedef struct {
+    unsigned int subjects;
+    unsigned int handled;       // by the family parser, without falling back
+    unsigned int mismatched;
+    uint64_t     genericNanoseconds;
+    uint64_t     familyNanoseconds;
+} tFamilyResult;
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool sameTokens(const tSubjectInfo * a, const tSubjectInfo * b) {
+    if ( a->tokenCount != b->tokenCount ) {
+        return false;
+    }
+    unsigned int count = a->tokenCount < kMaxSubjectTokens ? a->tokenCount : kMaxSubjectTokens;
+    for ( unsigned int i = 0; i < count; i++ ) {
+        const tSubjectToken * x = &a->tokens[ i ];
+        const tSubjectToken * y = &b->tokens[ i ];
+        if ( x->kind != y->kind || x->type != y->type || x->terminator != y->terminator
+             || x->span.offset != y->span.offset || x->span.length != y->span.length ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * read the subjects, one per line, trimming each and working out its family.
+ * The lines stay in buffer, which is never freed.
+ */
+static tSample * readSamples(FILE * file, size_t * count) {
+    char * line = NULL;
+    size_t lineSize = 0;
+    ssize_t length;
+    size_t capacity = 0;
+    tSample * samples = NULL;
+
+    *count = 0;
+    while ( (length = getline(&line, &lineSize, file)) >= 0 ) {
+        if ( length > 0 && line[ length - 1 ] == '\n' ) {
+            line[ --length ] = '\0';
+        }
+        if ( *count == capacity ) {
+            capacity = capacity == 0 ? 256 : capacity * 2;
+            tSample * grown = realloc(samples, capacity * sizeof(tSample));
+            if ( grown == NULL) {
+                return NULL;
+            }
+            samples = grown;
+        }
+        tSample * sample = &samples[ (*count)++ ];
+        sample->text = (const byte *) line;
+        sample->length = trimSubject(sample->text, (size_t) length);
+        sample->family = classifyFamily(sample->text, sample->length);
+
+        line = NULL;
+        lineSize = 0;
+    }
+    free(line);
+    return samples;
+}
+
+int main(int argc, char * const argv[]) {
+    const char * myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    int rounds = kDefaultRounds;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch ( opt ) {
+        case 'r':
+            rounds = atoi(optarg);
+            if ( rounds > 0 ) {
+                break;
+            }
+            /* fall through */
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [subjects.txt]\n", myName);
+            exit(EINVAL);
+        }
+    }
+
+    FILE * file = stdin;
+    if ( optind < argc ) {
+        file = fopen(argv[ optind ], "r");
+        if ( file == NULL) {
+            fprintf(stderr, "### %s: error: unable to open \'%s\' (%d: %s)\n",
+                    myName, argv[ optind ], errno, strerror(errno));
+            exit(-errno);
+        }
+    }
+    size_t count;
+    tSample * samples = readSamples(file, &count);
+    if ( samples == NULL && count > 0 ) {
+        fprintf(stderr, "### %s: error: out of memory\n", myName);
+        exit(-ENOMEM);
+    }
+
+    tFamilyResult results[ kFamilyMax ] = { 0 };
+    tSubjectInfo generic;
+    tSubjectInfo info;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        const tSample * sample = &samples[ i ];
+        tFamilyResult * result = &results[ sample->family ];
+
+        generic.trimmed = (tSpan) { 0, (unsigned int) sample->length };
+        info.trimmed = generic.trimmed;
+        tokenizeSubject(sample->text, &generic, kParse_Default);
+
+        result->subjects++;
+        if ( parseFamily(sample->family, sample->text, &info)) {
+            result->handled++;
+            if ( !sameTokens(&generic, &info)) {
+                result->mismatched++;
+                fprintf(stderr, "mismatch (%s): %.*s\n",
+                        describeFamily(sample->family), (int) sample->length, sample->text);
+            }
+        }
+
+        uint64_t start = now();
+        for ( int r = 0; r < rounds; r++ ) {
+            tokenizeSubject(sample->text, &generic, kParse_Default);
+        }
+        uint64_t middle = now();
+        for ( int r = 0; r < rounds; r++ ) {
+            /* what processSubject() does: the family parser, falling back to the tokenizer */
+            if ( !parseFamily(sample->family, sample->text, &info)) {
+                tokenizeSubject(sample->text, &info, kParse_Default);
+            }
+        }
+        uint64_t end = now();
+
+        result->genericNanoseconds += middle - start;
+        result->familyNanoseconds += end - middle;
+    }
+
+    printf("%-10s %9s %9s %12s %12s %8s\n", "family", "subjects", "handled", "generic ns", "family ns", "speedup");
+    for ( int f = 0; f < kFamilyMax; f++ ) {
+        const tFamilyResult * result = &results[ f ];
+        if ( result->subjects == 0 ) {
+            continue;
+        }
+        double calls = (double) result->subjects * rounds;
+        double genericAverage = result->genericNanoseconds / calls;
+        double familyAverage = result->familyNanoseconds / calls;
+        printf("%-10s %9u %9u %12.1f %12.1f %7.2fx\n",
+               describeFamily((tSubjectFamily) f), result->subjects, result->handled,
+               genericAverage, familyAverage, familyAverage > 0 ? genericAverage / familyAverage : 0.0);
+    }
+
+    unsigned int mismatched = 0;
+    for ( int f = 0; f < kFamilyMax; f++ ) {
+        mismatched += results[ f ].mismatched;
+    }
+    if ( mismatched > 0 ) {
+        fprintf(stderr, "### %s: error: %u subjects tokenized differently\n", myName, mismatched);
+        return 1;
+    }
+    return 0;
+}
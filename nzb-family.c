@@ -0,0 +1,353 @@
+
+#include <string.h>
+
+#include "nzb-family.h"
+
+static const char * familyNames[ kFamilyMax ] = {
+    [kFamily_Generic] = "generic",
+    [kFamily_Quoted]  = "quoted",
+    [kFamily_Hash]    = "hash",
+    [kFamily_Counter] = "counter",
+    [kFamily_Private] = "PRiVATE",
+    [kFamily_N3wZ]    = "N3wZ",
+    [kFamily_Indexer] = "indexer"
+};
+
+/* the bare hash family starts with an MD5 in hex */
+#define kHashLength  32
+
+/* where we are in the subject */
+typedef struct {
+    const byte   * subject;
+    const byte   * p;
+    const byte   * end;     // of the trimmed subject
+    tSubjectInfo * info;
+} tCursor;
+
+static inline bool isSeparator(byte c) {
+    return c == ' ' || c == '-' || c == '\0';
+}
+
+static inline bool isRunEnd(byte c) {
+    return isSeparator(c) || c == '"' || c == '[' || c == ']';
+}
+
+static inline bool isHexDigit(byte c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline bool isDigit(byte c) {
+    return c >= '0' && c <= '9';
+}
+
+/** @return the character at q, or the '\0' the tokenizer sees at the end */
+static inline byte charAt(const tCursor * cursor, const byte * q) {
+    return q < cursor->end ? *q : '\0';
+}
+
+static inline bool startsWith(const tCursor * cursor, const char * prefix, size_t length) {
+    return (size_t) (cursor->end - cursor->p) >= length && memcmp(cursor->p, prefix, length) == 0;
+}
+
+/**
+ * record a token, trimmed of separators at either end, just as the
+ * tokenizer's addToken() does.
+ * @param type kToken_Unset to have tokenType() work it out
+ */
+static void addToken(tCursor * cursor, tTokenType kind, tTokenType type,
+                     const byte * start, const byte * end, unsigned char terminator) {
+    tSubjectInfo * info = cursor->info;
+
+    while ( start < end && isSeparator(*start)) start++;
+    while ( start < end && isSeparator(end[ -1 ])) end--;
+
+    if ( info->tokenCount < kMaxSubjectTokens ) {
+        tSubjectToken * token = &info->tokens[ info->tokenCount ];
+        token->kind = kind;
+        token->type = type != kToken_Unset ? type : tokenType(kind, start, end - start);
+        token->span.offset = (unsigned int) (start - cursor->subject);
+        token->span.length = (unsigned int) (end - start);
+        token->terminator = terminator;
+    }
+    info->tokenCount++;
+}
+
+static inline void skipSeparators(tCursor * cursor) {
+    while ( cursor->p < cursor->end && isSeparator(*cursor->p)) cursor->p++;
+}
+
+/**
+ * The tokenizer runs a word straight after a closing quote or bracket into
+ * the closing character, and treats ']]' specially. Neither is worth
+ * copying, so after a closing character only expect a separator, an
+ * opening character or the end.
+ */
+static inline bool closedCleanly(const tCursor * cursor) {
+    byte next = charAt(cursor, cursor->p);
+    return isSeparator(next) || next == '"' || next == '[';
+}
+
+/** a word outside of quotes or brackets, at cursor->p */
+static bool takeWord(tCursor * cursor) {
+    const byte * start = cursor->p;
+    const byte * q = start;
+    while ( q < cursor->end && !isRunEnd(*q)) q++;
+
+    byte terminator = charAt(cursor, q);
+    if ( terminator == ']' ) {
+        /* a stray closing bracket */
+        return false;
+    }
+    /* the tokenizer skips one character words */
+    if ( q - start > 1 ) {
+        addToken(cursor, kToken_Unquoted, kToken_Unset, start, q, terminator);
+    }
+    cursor->p = q;
+    return true;
+}
+
+/** a quoted token, with cursor->p at the opening quote */
+static bool takeQuoted(tCursor * cursor) {
+    const byte * start = cursor->p + 1;
+    const byte * close = memchr(start, '"', cursor->end - start);
+    if ( close == NULL) {
+        return false;
+    }
+    /* brackets inside quotes still count towards the nesting */
+    if ( memchr(start, '[', close - start) != NULL || memchr(start, ']', close - start) != NULL) {
+        return false;
+    }
+    addToken(cursor, kToken_Quoted, kToken_Unset, start, close, '"');
+    cursor->p = close + 1;
+    return closedCleanly(cursor);
+}
+
+/**
+ * a [bracketed] token, with cursor->p at the opening bracket.
+ * @param type the token's type if already known, otherwise kToken_Unset
+ */
+static bool takeBracketed(tCursor * cursor, tTokenType type) {
+    const byte * start = cursor->p + 1;
+    const byte * close = memchr(start, ']', cursor->end - start);
+    if ( close == NULL) {
+        return false;
+    }
+    /* nested brackets ('[[' included) and quotes are for the tokenizer */
+    if ( memchr(start, '[', close - start) != NULL || memchr(start, '"', close - start) != NULL) {
+        return false;
+    }
+    addToken(cursor, kToken_String, type, start, close, ']');
+    cursor->p = close + 1;
+    return closedCleanly(cursor);
+}
+
+/** an indexer tag like '[PRiVATE]', whose type is already known */
+static bool takeTag(tCursor * cursor, const char * tag, size_t length, tTokenType type) {
+    if ( !startsWith(cursor, tag, length)) {
+        return false;
+    }
+    addToken(cursor, kToken_String, type, cursor->p + 1, cursor->p + length - 1, ']');
+    cursor->p += length;
+    return closedCleanly(cursor);
+}
+
+/** a '[12/34]' counter, or failing that any other bracketed token */
+static bool takeCounter(tCursor * cursor) {
+    const byte * q = cursor->p + 1;
+    const byte * digits = q;
+    while ( q < cursor->end && isDigit(*q)) q++;
+    if ( q > digits && charAt(cursor, q) == '/' ) {
+        digits = ++q;
+        while ( q < cursor->end && isDigit(*q)) q++;
+        if ( q > digits && charAt(cursor, q) == ']' ) {
+            addToken(cursor, kToken_String, kToken_Fraction, cursor->p + 1, q, ']');
+            cursor->p = q + 1;
+            return closedCleanly(cursor);
+        }
+    }
+    return takeBracketed(cursor, kToken_Unset);
+}
+
+/**
+ * the rest of any subject without nesting: words, quoted and bracketed
+ * tokens, and the separators between them.
+ */
+static bool parseRest(tCursor * cursor) {
+    for ( ;; ) {
+        skipSeparators(cursor);
+        if ( cursor->p >= cursor->end ) {
+            return true;
+        }
+        bool taken;
+        switch ( *cursor->p ) {
+        case '"':
+            taken = takeQuoted(cursor);
+            break;
+
+        case '[':
+            taken = takeBracketed(cursor, kToken_Unset);
+            break;
+
+        case ']':
+            taken = false;
+            break;
+
+        default:
+            taken = takeWord(cursor);
+            break;
+        }
+        if ( !taken ) {
+            return false;
+        }
+    }
+}
+
+/* "name.par2" */
+static bool parseQuoted(tCursor * cursor) {
+    return takeQuoted(cursor) && parseRest(cursor);
+}
+
+/* 5e0c74c3d8a34c5080cbc4834b3d392c [1/40] "name.par2" */
+static bool parseHash(tCursor * cursor) {
+    if ( !takeWord(cursor)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( charAt(cursor, cursor->p) == '[' && !takeCounter(cursor)) {
+        return false;
+    }
+    return parseRest(cursor);
+}
+
+/* [01/57] - "name.par2" */
+static bool parseCounter(tCursor * cursor) {
+    return takeCounter(cursor) && parseRest(cursor);
+}
+
+/* [PRiVATE]-[WtFnZb]-[name.mkv]-[1/7] - "" */
+static bool parsePrivate(tCursor * cursor) {
+    if ( !takeTag(cursor, "[PRiVATE]", 9, kToken_PRiVATE)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( !startsWith(cursor, "[WtFnZb]", 8)) {
+        return parseRest(cursor);
+    }
+    if ( !takeTag(cursor, "[WtFnZb]", 8, kToken_WtFnZb)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( charAt(cursor, cursor->p) == '[' ) {
+        /* the filename */
+        if ( !takeBracketed(cursor, kToken_Unset)) {
+            return false;
+        }
+        skipSeparators(cursor);
+        if ( charAt(cursor, cursor->p) == '[' && !takeCounter(cursor)) {
+            return false;
+        }
+    }
+    return parseRest(cursor);
+}
+
+/* [N3wZ] \bdIcha192688\::[PRiVATE]-[WtFnZb]-... */
+static bool parseN3wZ(tCursor * cursor) {
+    if ( !takeTag(cursor, "[N3wZ]", 6, kToken_N3wZ)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( cursor->p < cursor->end && !isRunEnd(*cursor->p) && !takeWord(cursor)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( startsWith(cursor, "[PRiVATE]", 9)) {
+        return parsePrivate(cursor);
+    }
+    return parseRest(cursor);
+}
+
+/* [145943]-[FULL]-[#a.b.teevee]-[ name ]-[01/44] - "name.mkv" */
+static bool parseIndexer(tCursor * cursor) {
+    if ( !takeBracketed(cursor, kToken_Number)) {
+        return false;
+    }
+    skipSeparators(cursor);
+    if ( startsWith(cursor, "[FULL]", 6) && !takeTag(cursor, "[FULL]", 6, kToken_FULL)) {
+        return false;
+    }
+    return parseRest(cursor);
+}
+
+tSubjectFamily classifyFamily(const byte * subject, size_t length) {
+    if ( length == 0 ) {
+        return kFamily_Generic;
+    }
+
+    switch ( subject[ 0 ] ) {
+    case '"':
+        return kFamily_Quoted;
+
+    case '[':
+        if ( length >= 9 && memcmp(subject, "[PRiVATE]", 9) == 0 ) {
+            return kFamily_Private;
+        }
+        if ( length >= 6 && memcmp(subject, "[N3wZ]", 6) == 0 ) {
+            return kFamily_N3wZ;
+        }
+        size_t i = 1;
+        while ( i < length && isDigit(subject[ i ])) i++;
+        if ( i > 1 && i + 1 < length ) {
+            if ( subject[ i ] == '/' ) {
+                return kFamily_Counter;
+            }
+            if ( subject[ i ] == ']' && subject[ i + 1 ] == '-' ) {
+                return kFamily_Indexer;
+            }
+        }
+        return kFamily_Generic;
+
+    default:
+        if ( length > kHashLength && subject[ kHashLength ] == ' ' ) {
+            for ( size_t j = 0; j < kHashLength; j++ ) {
+                if ( !isHexDigit(subject[ j ])) {
+                    return kFamily_Generic;
+                }
+            }
+            return kFamily_Hash;
+        }
+        return kFamily_Generic;
+    }
+}
+
+bool parseFamily(tSubjectFamily family, const byte * subject, tSubjectInfo * info) {
+    tCursor cursor = { subject, subject, subject + info->trimmed.length, info };
+
+    info->tokenCount = 0;
+    switch ( family ) {
+    case kFamily_Quoted:
+        return parseQuoted(&cursor);
+
+    case kFamily_Hash:
+        return parseHash(&cursor);
+
+    case kFamily_Counter:
+        return parseCounter(&cursor);
+
+    case kFamily_Private:
+        return parsePrivate(&cursor);
+
+    case kFamily_N3wZ:
+        return parseN3wZ(&cursor);
+
+    case kFamily_Indexer:
+        return parseIndexer(&cursor);
+
+    case kFamily_Generic:
+    default:
+        return false;
+    }
+}
+
+const char * describeFamily(tSubjectFamily family) {
+    return family < kFamilyMax ? familyNames[ family ] : "unknown";
+}
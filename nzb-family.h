@@ -0,0 +1,39 @@
+
+#ifndef NZB_FAMILY_H
+#define NZB_FAMILY_H
+
+#include <stdbool.h>
+
+#include "nzb-subject.h"
+
+/**
+ * The shapes of subject seen in the wild (see the list above
+ * preprocessSubject()), each with a parser of its own that knows what to
+ * expect. A family parser gives exactly the tokens the generic tokenizer
+ * would; it gives up on anything it isn't sure of, and the subject goes to
+ * the generic tokenizer instead.
+ */
+typedef enum {
+    kFamily_Generic = 0,    // none of the below
+    kFamily_Quoted,         // "name.par2" yEnc (01/17)
+    kFamily_Hash,           // 5e0c74c3d8a34c5080cbc4834b3d392c [1/40] "name.par2" yEnc (1/1)
+    kFamily_Counter,        // [01/57] - "name.par2" yEnc (1/1)
+    kFamily_Private,        // [PRiVATE]-[WtFnZb]-[name.mkv]-[1/7] - "" yEnc
+    kFamily_N3wZ,           // [N3wZ] \bdIcha192688\::[PRiVATE]-[WtFnZb]-[4]-[1/name.mkv] - "" yEnc
+    kFamily_Indexer,        // [145943]-[FULL]-[#a.b.teevee]-[ name ]-[01/44] - "name.mkv" yEnc (1/43)
+    kFamilyMax
+} tSubjectFamily;
+
+/** @return the family of the (trimmed) subject, from its first few bytes */
+tSubjectFamily classifyFamily(const byte * subject, size_t length);
+
+/**
+ * tokenize the subject (info->trimmed) with the family's own parser.
+ * @return false if it had to give up, leaving the subject to tokenizeSubject()
+ */
+bool parseFamily(tSubjectFamily family, const byte * subject, tSubjectInfo * info);
+
+/** @return the family's name, for statistics */
+const char * describeFamily(tSubjectFamily family);
+
+#endif
@@ -0,0 +1,168 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nzb-ids.h"
+
+/* the most a varint of a size_t takes */
+#define kMaxVarint  10
+
+void idStoreInit(tIdStore * store) {
+    memset(store, 0, sizeof(tIdStore));
+}
+
+void idStoreRelease(tIdStore * store) {
+    free(store->data);
+    free(store->blocks);
+    idStoreInit(store);
+}
+
+size_t idStoreMemory(const tIdStore * store) {
+    return store->size + store->blockCapacity * sizeof(uint32_t);
+}
+
+/** write value seven bits a byte, lowest first, with the top bit set on all but the last */
+static uint8_t * putVarint(uint8_t * p, size_t value) {
+    while ( value >= 0x80 ) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+static const uint8_t * takeVarint(const uint8_t * p, size_t * value) {
+    size_t result = 0;
+    for ( unsigned int shift = 0;; shift += 7 ) {
+        uint8_t b = *p++;
+        result |= (size_t) (b & 0x7F) << shift;
+        if ( !(b & 0x80)) {
+            break;
+        }
+    }
+    *value = result;
+    return p;
+}
+
+bool idStoreAdd(tIdStore * store, const char * id, size_t length) {
+    bool newBlock = store->count % kIdBlock == 0;
+    if ( newBlock ) {
+        if ( store->count / kIdBlock == store->blockCapacity ) {
+            size_t capacity = store->blockCapacity == 0 ? 256 : store->blockCapacity * 2;
+            uint32_t * blocks = realloc(store->blocks, capacity * sizeof(uint32_t));
+            if ( blocks == NULL) {
+                return false;
+            }
+            store->blocks = blocks;
+            store->blockCapacity = capacity;
+        }
+        store->previousLength = 0;
+    }
+
+    /* what it has in common with the one before, without the two overlapping */
+    const char * previous = store->previous;
+    size_t shared = length < store->previousLength ? length : store->previousLength;
+    size_t prefix = 0;
+    while ( prefix < shared && id[ prefix ] == previous[ prefix ] ) prefix++;
+    size_t suffix = 0;
+    while ( suffix < shared - prefix
+            && id[ length - 1 - suffix ] == previous[ store->previousLength - 1 - suffix ] ) suffix++;
+    size_t middle = length - prefix - suffix;
+
+    size_t needed = store->length + 3 * kMaxVarint + middle;
+    if ( needed > UINT32_MAX ) {
+        return false;
+    }
+    if ( needed > store->size ) {
+        size_t size = store->size == 0 ? 64 * 1024 : store->size;
+        while ( size < needed ) {
+            size *= 2;
+        }
+        uint8_t * data = realloc(store->data, size);
+        if ( data == NULL) {
+            return false;
+        }
+        store->data = data;
+        store->size = size;
+    }
+
+    if ( newBlock ) {
+        store->blocks[ store->count / kIdBlock ] = (uint32_t) store->length;
+    }
+    uint8_t * p = store->data + store->length;
+    p = putVarint(p, prefix);
+    p = putVarint(p, suffix);
+    p = putVarint(p, middle);
+    memcpy(p, id + prefix, middle);
+    store->length = (size_t) (p + middle - store->data);
+    store->idsLength += length + 1;
+    store->count++;
+
+    if ( length <= kIdMaxShared ) {
+        memcpy(store->previous, id, length);
+        store->previousLength = length;
+    } else {
+        store->previousLength = 0;
+    }
+    return true;
+}
+
+void idStoreTrim(tIdStore * store) {
+    if ( store->length > 0 ) {
+        uint8_t * data = realloc(store->data, store->length);
+        if ( data != NULL) {
+            store->data = data;
+            store->size = store->length;
+        }
+    }
+    size_t blocks = (store->count + kIdBlock - 1) / kIdBlock;
+    if ( blocks > 0 ) {
+        uint32_t * shrunk = realloc(store->blocks, blocks * sizeof(uint32_t));
+        if ( shrunk != NULL) {
+            store->blocks = shrunk;
+            store->blockCapacity = blocks;
+        }
+    }
+}
+
+/** @return used, plus as much of part as fits in buffer, leaving room for the '\0' */
+static size_t appendPart(char * buffer, size_t size, size_t used, const char * part, size_t length) {
+    if ( length > size - 1 - used ) {
+        length = size - 1 - used;
+    }
+    memcpy(buffer + used, part, length);
+    return used + length;
+}
+
+size_t idStoreGet(const tIdStore * store, size_t id, char * buffer, size_t size) {
+    char previous[ kIdMaxShared ];
+    size_t previousLength = 0;
+    const uint8_t * p = store->data + store->blocks[ id / kIdBlock ];
+
+    /* from the start of the block, each id is decoded over the one before */
+    for ( size_t i = id - id % kIdBlock;; i++ ) {
+        size_t prefix, suffix, middle;
+        p = takeVarint(p, &prefix);
+        p = takeVarint(p, &suffix);
+        p = takeVarint(p, &middle);
+        size_t length = prefix + middle + suffix;
+
+        if ( i == id ) {
+            if ( size > 0 ) {
+                size_t used = appendPart(buffer, size, 0, previous, prefix);
+                used = appendPart(buffer, size, used, (const char *) p, middle);
+                used = appendPart(buffer, size, used, previous + previousLength - suffix, suffix);
+                buffer[ used ] = '\0';
+            }
+            return length;
+        }
+        if ( length <= kIdMaxShared ) {
+            memmove(previous + prefix + middle, previous + previousLength - suffix, suffix);
+            memcpy(previous + prefix, p, middle);
+            previousLength = length;
+        } else {
+            previousLength = 0;
+        }
+        p += middle;
+    }
+}
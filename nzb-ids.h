@@ -0,0 +1,58 @@
+
+#ifndef NZB_IDS_H
+#define NZB_IDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ids per block: getting one decodes at most this many */
+#define kIdBlock        16
+/* longer ids are kept whole, and the next one doesn't share with them */
+#define kIdMaxShared    512
+
+/**
+ * Message-ids, front-coded: they're most of what an NZB holds, and the ids
+ * of a file's segments tend to differ from each other only in the middle -
+ *
+ *   part1of1150.b$tFSzuAbGeU2YS0TER2@powerpost2000AA.local
+ *   part2of1150.b$tFSzuAbGeU2YS0TER2@powerpost2000AA.local
+ *
+ * so each is kept as how much it shares with the start and the end of the
+ * one before, and what's left in between: three varints and the bytes.
+ * Every kIdBlock-th id starts a block, and shares nothing, so any id can be
+ * decoded from the start of its block without looking further back.
+ */
+typedef struct {
+    size_t     count;
+    uint8_t  * data;            // the ids, block after block
+    size_t     length;
+    uint32_t * blocks;          // offset in data of each block
+    size_t     idsLength;       // of the ids as they came, each zero-terminated
+
+    /* while they're being added */
+    size_t     size;
+    size_t     blockCapacity;
+    size_t     previousLength;  // 0 if too long to share with
+    char       previous[ kIdMaxShared ];
+} tIdStore;
+
+void idStoreInit(tIdStore * store);
+void idStoreRelease(tIdStore * store);
+
+/** @return false if out of memory, or over 4 GB of data */
+bool idStoreAdd(tIdStore * store, const char * id, size_t length);
+/** give back what was allocated ahead, once all the ids are in */
+void idStoreTrim(tIdStore * store);
+
+/**
+ * decode the id'th id, copying as much of it as fits into buffer, always
+ * zero-terminated (unless size is 0), like snprintf().
+ * @return its whole length
+ */
+size_t idStoreGet(const tIdStore * store, size_t id, char * buffer, size_t size);
+
+/** @return how much memory the store holds, for statistics */
+size_t idStoreMemory(const tIdStore * store);
+
+#endif
@@ -0,0 +1,183 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nzb-index.h"
+
+void initIndex(tNzbIndex * index) {
+    memset(index, 0, sizeof(tNzbIndex));
+}
+
+void releaseIndex(tNzbIndex * index) {
+    free(index->subject);
+    free(index->name);
+    free(index->firstSegment);
+    free(index->groups);
+    free(index->number);
+    free(index->bytes);
+    idStoreRelease(&index->messageIds);
+    free(index->strings);
+    initIndex(index);
+}
+
+size_t indexMemory(const tNzbIndex * index) {
+    return index->fileCapacity * (3 * sizeof(uint32_t) + sizeof(uint64_t))
+         + index->segmentCapacity * 2 * sizeof(uint32_t)
+         + idStoreMemory(&index->messageIds)
+         + index->stringsSize;
+}
+
+/** grow one of the arrays to capacity elements, failing the index if it can't */
+static bool growArray(tNzbIndex * index, void * array, size_t capacity, size_t size) {
+    void * grown = realloc(*(void **) array, capacity * size);
+    if ( grown == NULL) {
+        index->failed = true;
+        return false;
+    }
+    *(void **) array = grown;
+    return true;
+}
+
+/** shrink one of the arrays to capacity elements, if it can be */
+static void shrinkArray(void * array, size_t capacity, size_t size) {
+    if ( capacity == 0 || *(void **) array == NULL) {
+        return;
+    }
+    void * shrunk = realloc(*(void **) array, capacity * size);
+    if ( shrunk != NULL) {
+        *(void **) array = shrunk;
+    }
+}
+
+void trimIndex(tNzbIndex * index) {
+    /* the files' arrays must keep room for the end of the last one's segments */
+    if ( index->fileCount > 0 ) {
+        size_t capacity = index->fileCount + 1;
+        shrinkArray(&index->subject, capacity, sizeof(uint32_t));
+        shrinkArray(&index->name, capacity, sizeof(uint32_t));
+        shrinkArray(&index->firstSegment, capacity, sizeof(uint32_t));
+        shrinkArray(&index->groups, capacity, sizeof(uint64_t));
+        index->fileCapacity = capacity;
+    }
+    if ( index->segmentCount > 0 ) {
+        shrinkArray(&index->number, index->segmentCount, sizeof(uint32_t));
+        shrinkArray(&index->bytes, index->segmentCount, sizeof(uint32_t));
+        index->segmentCapacity = index->segmentCount;
+    }
+    if ( index->stringsLength > 0 ) {
+        shrinkArray(&index->strings, index->stringsLength, 1);
+        index->stringsSize = index->stringsLength;
+    }
+    idStoreTrim(&index->messageIds);
+}
+
+/** @return the offset of a copy of the string in the pool, or UINT32_MAX if it couldn't be added */
+static uint32_t addString(tNzbIndex * index, const char * string, size_t length) {
+    size_t needed = index->stringsLength + length + 1;
+    if ( needed > UINT32_MAX ) {
+        index->failed = true;
+        return UINT32_MAX;
+    }
+    if ( needed > index->stringsSize ) {
+        size_t size = index->stringsSize == 0 ? 64 * 1024 : index->stringsSize;
+        while ( size < needed ) {
+            size *= 2;
+        }
+        if ( !growArray(index, &index->strings, size, 1)) {
+            return UINT32_MAX;
+        }
+        index->stringsSize = size;
+    }
+
+    uint32_t offset = (uint32_t) index->stringsLength;
+    memcpy(index->strings + offset, string, length);
+    index->strings[ offset + length ] = '\0';
+    index->stringsLength = needed;
+    return offset;
+}
+
+bool openIndexFile(tNzbIndex * index) {
+    if ( index->failed ) {
+        return false;
+    }
+    /* room for this file, and the end of its segments */
+    if ( index->fileCount + 2 > index->fileCapacity ) {
+        size_t capacity = index->fileCapacity == 0 ? 256 : index->fileCapacity * 2;
+        if ( !growArray(index, &index->subject, capacity, sizeof(uint32_t))
+             || !growArray(index, &index->name, capacity, sizeof(uint32_t))
+             || !growArray(index, &index->firstSegment, capacity, sizeof(uint32_t))
+             || !growArray(index, &index->groups, capacity, sizeof(uint64_t))) {
+            return false;
+        }
+        index->fileCapacity = capacity;
+    }
+    index->firstSegment[ index->fileCount ] = (uint32_t) index->segmentCount;
+    index->openGroups = 0;
+    return true;
+}
+
+bool addIndexGroup(tNzbIndex * index, const char * name) {
+    if ( index->failed ) {
+        return false;
+    }
+    for ( size_t i = 0; i < index->groupCount; i++ ) {
+        if ( strcmp(indexString(index, index->group[ i ]), name) == 0 ) {
+            index->openGroups |= (uint64_t) 1 << i;
+            return true;
+        }
+    }
+    if ( index->groupCount == kIndexMaxGroups ) {
+        return true;
+    }
+
+    uint32_t offset = addString(index, name, strlen(name));
+    if ( offset == UINT32_MAX ) {
+        return false;
+    }
+    index->openGroups |= (uint64_t) 1 << index->groupCount;
+    index->group[ index->groupCount++ ] = offset;
+    return true;
+}
+
+bool addIndexSegment(tNzbIndex * index, uint32_t number, uint32_t bytes, const char * messageId, size_t length) {
+    if ( index->failed ) {
+        return false;
+    }
+    if ( index->segmentCount == index->segmentCapacity ) {
+        size_t capacity = index->segmentCapacity == 0 ? 4096 : index->segmentCapacity * 2;
+        if ( capacity > UINT32_MAX
+             || !growArray(index, &index->number, capacity, sizeof(uint32_t))
+             || !growArray(index, &index->bytes, capacity, sizeof(uint32_t))) {
+            index->failed = true;
+            return false;
+        }
+        index->segmentCapacity = capacity;
+    }
+
+    if ( !idStoreAdd(&index->messageIds, messageId, length)) {
+        index->failed = true;
+        return false;
+    }
+    size_t i = index->segmentCount++;
+    index->number[ i ] = number;
+    index->bytes[ i ] = bytes;
+    return true;
+}
+
+bool closeIndexFile(tNzbIndex * index, const char * subject, size_t length, tSpan filename) {
+    if ( index->failed ) {
+        return false;
+    }
+    uint32_t subjectOffset = addString(index, subject, length);
+    uint32_t nameOffset = addString(index, subject + filename.offset, filename.length);
+    if ( subjectOffset == UINT32_MAX || nameOffset == UINT32_MAX ) {
+        return false;
+    }
+
+    size_t i = index->fileCount++;
+    index->subject[ i ] = subjectOffset;
+    index->name[ i ] = nameOffset;
+    index->groups[ i ] = index->openGroups;
+    index->firstSegment[ i + 1 ] = (uint32_t) index->segmentCount;
+    return true;
+}
@@ -0,0 +1,85 @@
+
+#ifndef NZB_INDEX_H
+#define NZB_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nzb-subject.h"
+#include "nzb-ids.h"
+
+/* only this many of an NZB's groups get a bit in the files' masks */
+#define kIndexMaxGroups  64
+
+/**
+ * Everything worth keeping from an NZB, as parallel arrays, so a downloader
+ * can walk millions of segments in order without chasing a pointer. Every
+ * string is zero-terminated in the one pool, and referred to by its offset,
+ * except the message-ids: they're most of it, so they're front-coded in a
+ * store of their own (see nzb-ids.h), and decoded on request.
+ *
+ * File i's segments are [firstSegment[ i ], firstSegment[ i + 1 ]): once
+ * there are any files, firstSegment has one more entry than there are.
+ * Only what the parser sees is indexed, so kParse_SubjectsOnly leaves out
+ * the segments.
+ */
+struct sNzbIndex {
+    size_t     fileCount;
+    uint32_t * subject;         // of each file
+    uint32_t * name;            // the filename resolved from the subject, "" if none was
+    uint32_t * firstSegment;
+    uint64_t * groups;          // bit n set if the file was posted to group n
+
+    size_t     segmentCount;
+    uint32_t * number;          // of each segment, in document order
+    uint32_t * bytes;
+    tIdStore   messageIds;
+
+    size_t     groupCount;
+    uint32_t   group[ kIndexMaxGroups ];
+
+    char     * strings;
+    size_t     stringsLength;
+
+    /* while it's being built */
+    size_t     fileCapacity;
+    size_t     segmentCapacity;
+    size_t     stringsSize;
+    uint64_t   openGroups;      // of the file being parsed
+    bool       failed;          // out of memory, or over 4 GB of strings
+};
+
+void initIndex(tNzbIndex * index);
+void releaseIndex(tNzbIndex * index);
+/** give back what was allocated ahead, once the NZB is parsed: for an index that's kept */
+void trimIndex(tNzbIndex * index);
+
+/** @return the zero-terminated string at offset in the pool */
+static inline const char * indexString(const tNzbIndex * index, uint32_t offset) {
+    return index->strings + offset;
+}
+
+/**
+ * decode the segment's message-id into buffer, as much of it as fits, like
+ * snprintf(); 1 KB is plenty for any id a news server would take.
+ * @return its whole length
+ */
+static inline size_t indexMessageId(const tNzbIndex * index, size_t segment, char * buffer, size_t size) {
+    return idStoreGet(&index->messageIds, segment, buffer, size);
+}
+
+/** @return how much memory the index holds, for statistics */
+size_t indexMemory(const tNzbIndex * index);
+
+/*
+ * Called by the parser as each element of interest closes; a <file> is
+ * opened before its groups and segments, and added once they're all in.
+ * Each returns false if the index couldn't grow, and is then ignored.
+ */
+bool openIndexFile(tNzbIndex * index);
+bool addIndexGroup(tNzbIndex * index, const char * name);
+bool addIndexSegment(tNzbIndex * index, uint32_t number, uint32_t bytes, const char * messageId, size_t length);
+bool closeIndexFile(tNzbIndex * index, const char * subject, size_t length, tSpan filename);
+
+#endif
@@ -0,0 +1,104 @@
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nzb-input.h"
+
+/* initial size of the buffer used when the input can't be mapped.
+ * Doubled whenever it fills up, so a multi-megabyte NZB on a pipe
+ * costs a handful of read() calls rather than one per 4K page. */
+#define kReadChunk  (256 * 1024)
+
+static int mapInput(tInput * input, int fd, size_t length) {
+    void * map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( map == MAP_FAILED ) {
+        return errno;
+    }
+    /* the parser makes a single front-to-back pass */
+    madvise(map, length, MADV_SEQUENTIAL);
+
+    input->data = map;
+    input->length = length;
+    input->mapped = true;
+    return 0;
+}
+
+int readInput(tInput * input, int fd) {
+    struct stat info;
+
+    memset(input, 0, sizeof(tInput));
+
+    if ( fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 ) {
+        if ( mapInput(input, fd, (size_t) info.st_size) == 0 ) {
+            return 0;
+        }
+        /* fall through and read() it instead */
+    }
+
+    size_t size = kReadChunk;
+    size_t length = 0;
+    unsigned char * buffer = malloc(size);
+    if ( buffer == NULL) {
+        return ENOMEM;
+    }
+
+    for (;;) {
+        if ( length == size ) {
+            unsigned char * bigger = realloc(buffer, size * 2);
+            if ( bigger == NULL) {
+                free(buffer);
+                return ENOMEM;
+            }
+            buffer = bigger;
+            size *= 2;
+        }
+
+        ssize_t count = read(fd, &buffer[ length ], size - length);
+        if ( count == 0 ) {
+            break;
+        }
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+
+            int result = errno;
+            free(buffer);
+            return result;
+        }
+        length += count;
+    }
+
+    input->data = buffer;
+    input->length = length;
+    input->mapped = false;
+    return 0;
+}
+
+int openInput(tInput * input, const char * path) {
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        memset(input, 0, sizeof(tInput));
+        return errno;
+    }
+
+    int result = readInput(input, fd);
+    /* a mapping stays valid after the descriptor is closed */
+    close(fd);
+
+    return result;
+}
+
+void releaseInput(tInput * input) {
+    if ( input->data != NULL) {
+        if ( input->mapped ) {
+            munmap((void *) input->data, input->length);
+        } else {
+            free((void *) input->data);
+        }
+    }
+    memset(input, 0, sizeof(tInput));
+}
@@ -0,0 +1,36 @@
+
+#ifndef NZB_INPUT_H
+#define NZB_INPUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * An NZB document held as one contiguous span of bytes.
+ *
+ * Regular files are mmap()ed read-only; anything that can't be mapped
+ * (stdin, pipes, sockets) is slurped into a heap buffer with large read()s.
+ * Either way the parser only ever sees [data, data + length).
+ */
+typedef struct {
+    const unsigned char * data;
+    size_t length;
+    bool   mapped;   // true: munmap() on release, false: free()
+} tInput;
+
+/**
+ * open the file at path and load it into input.
+ * @return 0 on success, otherwise an errno value
+ */
+int openInput(tInput * input, const char * path);
+
+/**
+ * load everything readable from an already-open file descriptor into input.
+ * The descriptor is not closed.
+ * @return 0 on success, otherwise an errno value
+ */
+int readInput(tInput * input, int fd);
+
+void releaseInput(tInput * input);
+
+#endif
@@ -0,0 +1,238 @@
+
+/*
+ * Build-time generator for the subject keyword and separator lookups.
+ *
+ * Reads the lists in nzb-keywords.def and writes a header with a minimal
+ * perfect hash table for each (hash and displace: the high bits of the
+ * hash pick a bucket, and each bucket has a displacement that moves its
+ * keys into free slots). Every string gets a slot of its own, so a lookup
+ * is one hash, one slot and one compare.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "nzb-keywords.h"
+
+/* give up on a seed once a bucket needs a displacement this big */
+#define kMaxDisplacement  65536
+#define kMaxSeeds         100000
+
+typedef struct {
+    const char * string;
+    const char * value;     // the C initializer for what it maps to
+} tEntry;
+
+static const tEntry keywords[] = {
+#define KEYWORD( string, token )  { string, #token },
+#include "nzb-keywords.def"
+#undef KEYWORD
+};
+
+static const tEntry separators[] = {
+#define SEPARATOR( string, first, second )  { string, "{ " #first ", " #second " }" },
+#include "nzb-keywords.def"
+#undef SEPARATOR
+};
+
+#define countof( array )  (sizeof(array) / sizeof(array[ 0 ]))
+
+typedef struct {
+    const tEntry * entries;
+    size_t         count;
+    uint64_t       seed;
+    uint32_t     * displacement;    // per bucket
+    uint32_t     * slot;            // per entry
+} tTable;
+
+static uint64_t entryHash(const tTable * table, size_t i) {
+    const char * string = table->entries[ i ].string;
+    return keywordHash((const unsigned char *) string, strlen(string), table->seed);
+}
+
+/**
+ * try to place every entry with the table's current seed.
+ * @return false if some bucket can't be placed
+ */
+static bool place(tTable * table, bool * taken, size_t * order, size_t * members) {
+    size_t count = table->count;
+    size_t * bucketSize = calloc(count, sizeof(size_t));
+    if ( bucketSize == NULL) {
+        return false;
+    }
+
+    for ( size_t i = 0; i < count; i++ ) {
+        bucketSize[ (entryHash(table, i) >> 32) % count ]++;
+        taken[ i ] = false;
+        order[ i ] = i;
+    }
+    /* biggest buckets first, while there's still plenty of room */
+    for ( size_t i = 1; i < count; i++ ) {
+        for ( size_t j = i; j > 0 && bucketSize[ order[ j ]] > bucketSize[ order[ j - 1 ]]; j-- ) {
+            size_t swap = order[ j ];
+            order[ j ] = order[ j - 1 ];
+            order[ j - 1 ] = swap;
+        }
+    }
+
+    bool result = true;
+    for ( size_t b = 0; b < count && result && bucketSize[ order[ b ]] > 0; b++ ) {
+        size_t bucket = order[ b ];
+        size_t memberCount = 0;
+        for ( size_t i = 0; i < count; i++ ) {
+            if ( (entryHash(table, i) >> 32) % count == bucket ) {
+                members[ memberCount++ ] = i;
+            }
+        }
+
+        result = false;
+        for ( uint32_t d = 0; d < kMaxDisplacement && !result; d++ ) {
+            result = true;
+            for ( size_t m = 0; m < memberCount && result; m++ ) {
+                uint32_t slot = keywordSlot(entryHash(table, members[ m ]), d, (uint32_t) count);
+                result = !taken[ slot ];
+                for ( size_t n = 0; n < m && result; n++ ) {
+                    result = table->slot[ members[ n ]] != slot;
+                }
+                table->slot[ members[ m ]] = slot;
+            }
+            if ( result ) {
+                table->displacement[ bucket ] = d;
+                for ( size_t m = 0; m < memberCount; m++ ) {
+                    taken[ table->slot[ members[ m ]]] = true;
+                }
+            }
+        }
+    }
+
+    free(bucketSize);
+    return result;
+}
+
+static void releaseTable(tTable * table) {
+    free(table->displacement);
+    free(table->slot);
+    table->displacement = NULL;
+    table->slot = NULL;
+}
+
+/** @return 0, or an errno value if the table couldn't be built, with nothing left allocated */
+static int build(tTable * table) {
+    size_t count = table->count;
+
+    for ( size_t i = 0; i < count; i++ ) {
+        for ( size_t j = 0; j < i; j++ ) {
+            if ( strcmp(table->entries[ i ].string, table->entries[ j ].string) == 0 ) {
+                fprintf(stderr, "duplicate entry \"%s\"\n", table->entries[ i ].string);
+                return EINVAL;
+            }
+        }
+    }
+
+    table->displacement = calloc(count, sizeof(uint32_t));
+    table->slot = calloc(count, sizeof(uint32_t));
+    bool * taken = calloc(count, sizeof(bool));
+    size_t * order = calloc(count, sizeof(size_t));
+    size_t * members = calloc(count, sizeof(size_t));
+    int result = ENOMEM;
+
+    if ( table->displacement != NULL && table->slot != NULL
+         && taken != NULL && order != NULL && members != NULL) {
+        /* deterministic seeds, so the build is reproducible */
+        uint64_t seed = 0x6e7a622d7375626a;
+        result = EDOM;
+        for ( int attempt = 0; attempt < kMaxSeeds && result != 0; attempt++ ) {
+            seed = seed * 6364136223846793005 + 1442695040888963407;
+            table->seed = seed;
+            if ( place(table, taken, order, members)) {
+                result = 0;
+            }
+        }
+    }
+    free(taken);
+    free(order);
+    free(members);
+    if ( result != 0 ) {
+        releaseTable(table);
+    }
+    return result;
+}
+
+static void writeString(FILE * out, const char * string) {
+    fputc('"', out);
+    for ( const char * p = string; *p != '\0'; p++ ) {
+        if ( *p == '"' || *p == '\\' ) {
+            fputc('\\', out);
+        }
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void writeTable(FILE * out, const tTable * table, const char * prefix, const char * type) {
+    char upper[ 64 ];
+    snprintf(upper, sizeof(upper), "%s", prefix);
+    upper[ 0 ] = (char) (upper[ 0 ] - 'a' + 'A');
+
+    fprintf(out, "#define k%sCount  %zu\n", upper, table->count);
+    fprintf(out, "#define k%sSeed   0x%016llxull\n\n", upper, (unsigned long long) table->seed);
+
+    fprintf(out, "static const uint16_t %sDisplacement[ k%sCount ] = {", prefix, upper);
+    for ( size_t i = 0; i < table->count; i++ ) {
+        fprintf(out, "%s%u,", i % 12 == 0 ? "\n    " : " ", table->displacement[ i ]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const %s %sTable[ k%sCount ] = {\n", type, prefix, upper);
+    for ( size_t i = 0; i < table->count; i++ ) {
+        fprintf(out, "    [ %u ] = { ", table->slot[ i ]);
+        writeString(out, table->entries[ i ].string);
+        fprintf(out, ", %zu, %s },\n", strlen(table->entries[ i ].string), table->entries[ i ].value);
+    }
+    fprintf(out, "};\n\n");
+}
+
+int main(int argc, char * argv[]) {
+    if ( argc != 2 ) {
+        fprintf(stderr, "usage: %s output.h\n", argv[ 0 ]);
+        exit(EINVAL);
+    }
+
+    tTable keywordTable = { .entries = keywords, .count = countof(keywords) };
+    tTable separatorTable = { .entries = separators, .count = countof(separators) };
+    int result = build(&keywordTable);
+    if ( result == 0 ) {
+        result = build(&separatorTable);
+    }
+    if ( result != 0 ) {
+        releaseTable(&keywordTable);
+        fprintf(stderr, "### %s: error: unable to build the tables (%d: %s)\n",
+                argv[ 0 ], result, strerror(result));
+        exit(-result);
+    }
+
+    FILE * out = fopen(argv[ 1 ], "w");
+    if ( out == NULL) {
+        result = errno;
+        releaseTable(&keywordTable);
+        releaseTable(&separatorTable);
+        fprintf(stderr, "### %s: error: unable to create \'%s\' (%d: %s)\n",
+                argv[ 0 ], argv[ 1 ], result, strerror(result));
+        exit(-result);
+    }
+    fprintf(out, "/* generated by nzb-keywords-gen from nzb-keywords.def - do not edit */\n\n");
+    writeTable(out, &keywordTable, "keyword", "tKeywordEntry");
+    writeTable(out, &separatorTable, "separator", "tSeparatorEntry");
+    releaseTable(&keywordTable);
+    releaseTable(&separatorTable);
+    if ( fclose(out) != 0 ) {
+        result = errno;
+        fprintf(stderr, "### %s: error: unable to write \'%s\' (%d: %s)\n",
+                argv[ 0 ], argv[ 1 ], result, strerror(result));
+        exit(-result);
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+
+#include <string.h>
+
+#include "nzb-keywords.h"
+
+typedef struct {
+    const char * string;
+    size_t       length;
+    tTokenType   token;
+} tKeywordEntry;
+
+typedef struct {
+    const char    * string;
+    size_t          length;
+    tSeparatorIndex index[2];
+} tSeparatorEntry;
+
+/* generated at build time from nzb-keywords.def */
+#include "nzb-keywords-table.h"
+
+tTokenType lookupKeyword(const unsigned char * string, size_t length) {
+    uint64_t hash = keywordHash(string, length, kKeywordSeed);
+    const tKeywordEntry * entry = &keywordTable[
+        keywordSlot(hash, keywordDisplacement[ (hash >> 32) % kKeywordCount ], kKeywordCount) ];
+
+    /* anything can hash to a slot, so make sure it's really this one */
+    if ( entry->length == length && memcmp(entry->string, string, length) == 0 ) {
+        return entry->token;
+    }
+    return kToken_Unset;
+}
+
+const tSeparatorIndex * lookupSeparator(const unsigned char * string, size_t length) {
+    uint64_t hash = keywordHash(string, length, kSeparatorSeed);
+    const tSeparatorEntry * entry = &separatorTable[
+        keywordSlot(hash, separatorDisplacement[ (hash >> 32) % kSeparatorCount ], kSeparatorCount) ];
+
+    if ( entry->length == length && memcmp(entry->string, string, length) == 0 ) {
+        return entry->index;
+    }
+    return NULL;
+}
@@ -0,0 +1,74 @@
+
+#ifndef NZB_KEYWORDS_H
+#define NZB_KEYWORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    kToken_Unset = 0,
+    kToken_Separator, // 1
+    kToken_Unquoted,  // 2
+    kToken_Quoted,    // 3
+    kToken_Empty,     // 4
+    kToken_String,    // 5
+    kToken_Number,    // 6
+    kToken_Fraction,  // 7
+    kToken_WtFnZb,    // 8
+    kToken_PRiVATE,   // 9
+    kToken_N3wZ,      // a
+    kToken_newzNZB,   // b
+    kToken_FULL,      // c
+    kToken_yEnc,      // d
+    kToken_Of,        // e
+    kTokenTypeMax     // f
+} tTokenType;
+
+typedef enum {
+    kSep_nop = 0,             // ''
+    kSep_startSq,             // '[', '[ ', ' [', ' [ '
+    kSep_endSq,               // ']', '] ', ']  '
+    kSep_dash,                // ' -', ' - ', ' -  ', '--'
+    kSep_endBracket,          // ')', ') '
+    kSep_startBracket,        // '(', ' (', '  ('
+    kSep_emptyQuotes,         // '""'
+    kSep_startQuotes,         // ' "',
+    kSep_endQuotes,           // '" ', '"  '
+    kSep_space                // ' ', '  '
+} tSeparatorIndex;
+
+/**
+ * The hash behind the generated tables, shared with nzb-keywords-gen so
+ * both sides agree. Low 32 bits pick the slot, high 32 bits the bucket.
+ */
+static inline uint64_t keywordHash(const unsigned char * string, size_t length, uint64_t seed) {
+    uint64_t hash = seed ^ (length * 0x9e3779b97f4a7c15);
+    for ( size_t i = 0; i < length; i++ ) {
+        hash = (hash ^ string[ i ]) * 0x100000001b3;
+    }
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/** where a key with the given hash goes, once its bucket's displacement is known */
+static inline uint32_t keywordSlot(uint64_t hash, uint32_t displacement, uint32_t count) {
+    uint32_t f1 = (uint32_t) hash;
+    uint32_t f2 = (uint32_t) (hash >> 16) | 1;
+    return (f1 + displacement * f2) % count;
+}
+
+/**
+ * @return the token type of an indexer tag or other keyword,
+ *         or kToken_Unset if it isn't one
+ */
+tTokenType lookupKeyword(const unsigned char * string, size_t length);
+
+/**
+ * @return the pair of separator indexes for a run of separator characters,
+ *         or NULL if it isn't one we know
+ */
+const tSeparatorIndex * lookupSeparator(const unsigned char * string, size_t length);
+
+#endif
@@ -0,0 +1,407 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "yxml.h"
+#include "nzb-subject.h"
+#include "nzb-api.h"
+#include "nzb-input.h"
+#include "nzb-pool.h"
+
+/* how much of stdin is read, and parsed, at a time when streaming it */
+#define kStreamBuffer  (64 * 1024)
+
+/* one NZB named on the command line, and what became of it */
+typedef struct {
+    const char * path;
+    int     error;          // errno from opening it, 0 if it was read
+    int     result;         // from processInput()
+    char  * output;         // what it wrote, when processed by the pool
+    size_t  outputLength;
+    int     outputError;    // errno if there was no memory to write it to
+} tJob;
+
+/* what to do with each NZB, from the command line */
+typedef struct {
+    tParseFlags  flags;
+    unsigned int splitThreads;
+    bool         reportFiles;   // -F
+    bool         indexFiles;    // -I
+} tOptions;
+
+typedef struct {
+    const char    * myName;
+    tOptions        options;
+    tJob          * jobs;
+    bool          * done;
+    size_t          count;
+    size_t          nextToEmit;
+    const tJob    * failed;     // the first, in order, whose output stops there
+    pthread_mutex_t lock;
+} tBatch;
+
+/** onFile callback for -F: a line for each file, written to the context's FILE */
+void printFile(void * context, const tFileResult * file) {
+    FILE * out = context;
+    fprintf(out, "f: %u/%u %s, part %u/%u, %u segments, %" PRIu64 " bytes \"%.*s\"",
+            file->index, file->total, describeFamily(file->family), file->part, file->parts,
+            file->segments, file->bytes, (int) file->filename.length, file->subject + file->filename.offset);
+    if ( file->directory.length > 0 ) {
+        fprintf(out, " in \"%.*s\"", (int) file->directory.length, file->subject + file->directory.offset);
+    }
+    fputc('\n', out);
+}
+
+/** for -I: a line summing up the index built of an NZB */
+void printIndex(FILE * out, const tNzbIndex * index) {
+    /* the message-ids as they'd be in the pool: each zero-terminated, with an offset */
+    const tIdStore * ids = &index->messageIds;
+    fprintf(out, "i: %zu files, %zu segments, %zu groups, %zu bytes of strings, "
+                 "%zu bytes of message-ids (%zu unpacked), %zu bytes in all%s\n",
+            index->fileCount, index->segmentCount, index->groupCount, index->stringsLength,
+            ids->length, ids->idsLength + ids->count * sizeof(uint32_t),
+            indexMemory(index), index->failed ? " (incomplete: out of memory)" : "");
+}
+
+/** set up a document to process an NZB the way the options say */
+void prepareDocument(tDocument * document, const tOptions * options, FILE * out, tNzbIndex * index) {
+    memset(document, 0, sizeof(tDocument));
+    document->flags = options->flags;
+    document->out = out;
+    document->threads = options->splitThreads;
+    if ( options->reportFiles ) {
+        document->onFile = printFile;
+        document->context = out;
+    }
+    if ( options->indexFiles ) {
+        initIndex(index);
+        document->index = index;
+    }
+}
+
+/** release the document, and report the index built of it if there was one */
+void finishDocument(tDocument * document) {
+    if ( document->index != NULL) {
+        trimIndex(document->index);
+        printIndex(document->out, document->index);
+        releaseIndex(document->index);
+    }
+    releaseDocument(document);
+}
+
+/**
+ * open, read and process the job's file, writing the results to out.
+ */
+void runJob(tJob * job, const tOptions * options, FILE * out) {
+    tInput input;
+
+    job->error = openInput(&input, job->path);
+    if ( job->error == 0 ) {
+        tDocument document;
+        tNzbIndex index;
+        prepareDocument(&document, options, out, &index);
+        job->result = processInput(&document, input.data, input.length);
+        finishDocument(&document);
+        releaseInput(&input);
+    }
+}
+
+/** @return whether the job failed, in a way finishJob() would report */
+bool jobFailed(const tJob * job) {
+    return job->outputError != 0 || job->error != 0 || (job->result < 0 && job->result != YXML_EEOF);
+}
+
+/**
+ * report how the job went, after its output (if any) has been written.
+ * @return 0 if it went well, otherwise what to exit with: failures are
+ *         fatal, just as if the files had been processed one by one
+ */
+int finishJob(const char * myName, const tJob * job) {
+    if ( job->outputError != 0 ) {
+        fprintf(stderr, "### %s: error: out of memory\n", myName);
+        return -job->outputError;
+    }
+    if ( job->error != 0 ) {
+        fprintf(stderr,
+                "### %s: error: unable to open \'%s\' (%d: %s)\n",
+                myName, job->path, job->error, strerror(job->error));
+        return -job->error;
+    }
+    if ( job->result < 0 && job->result != YXML_EEOF ) {
+        return job->result;
+    }
+    return 0;
+}
+
+/**
+ * pool task: process one file into a memory buffer, then write out every
+ * result that's now next in line, so the output is in command line order.
+ * Once one has failed, nothing after it is written, or worth processing:
+ * main() reports it when the pool is done.
+ */
+void poolJob(void * context, size_t index, unsigned int worker) {
+    tBatch * batch = context;
+    tJob * job = &batch->jobs[ index ];
+    (void) worker;
+
+    pthread_mutex_lock(&batch->lock);
+    bool failed = batch->failed != NULL;
+    pthread_mutex_unlock(&batch->lock);
+    if ( !failed ) {
+        FILE * out = open_memstream(&job->output, &job->outputLength);
+        if ( out == NULL) {
+            job->outputError = errno;
+        } else {
+            runJob(job, &batch->options, out);
+            fclose(out);
+        }
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->done[ index ] = true;
+    while ( batch->failed == NULL && batch->nextToEmit < batch->count && batch->done[ batch->nextToEmit ] ) {
+        tJob * next = &batch->jobs[ batch->nextToEmit ];
+        fwrite(next->output, 1, next->outputLength, stdout);
+        free(next->output);
+        next->output = NULL;
+        if ( jobFailed(next)) {
+            batch->failed = next;
+        }
+        batch->nextToEmit++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/**
+ * parse a thread count for -j or -J: a number, and nothing else.
+ * @return false if it isn't one
+ */
+bool parseThreads(const char * text, int * threads) {
+    char * end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if ( end == text || *end != '\0' || errno != 0 || value < 0 || value > INT_MAX ) {
+        return false;
+    }
+    *threads = (int) value;
+    return true;
+}
+
+/**
+ * parse the document a read() at a time, so each file is reported while
+ * the rest is still arriving.
+ * @return as processFile()
+ */
+int streamInput(const char * myName, tDocument * document, int fd) {
+    static byte buffer[ kStreamBuffer ];
+
+    tParser * parser = createParser(document);
+    if ( parser == NULL) {
+        fprintf(stderr, "### %s: error: out of memory\n", myName);
+        exit(-ENOMEM);
+    }
+
+    int r = 0;
+    ssize_t count;
+    while ( r >= 0 && (count = read(fd, buffer, sizeof(buffer))) != 0 ) {
+        if ( count < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            fprintf(stderr, "### %s: error: unable to read stdin (%d: %s)\n", myName, errno, strerror(errno));
+            exit(-errno);
+        }
+        r = feedParser(parser, buffer, (size_t) count);
+    }
+    if ( r < 0 ) {
+        fprintf(stderr, "xml parser error %d\n", r);
+    }
+    r = finishParser(parser);
+    if ( r == YXML_EEOF ) {
+        fprintf(stderr, "xml error %d at end of file", r);
+    }
+    return r;
+}
+
+void usage(const char * myName) {
+    fprintf(stderr,
+            "usage: %s [-befFIprsSt] [-j threads] [-J threads] [file.nzb ...]\n"
+            "  -b  feed the XML parser a byte at a time (reference path)\n"
+            "  -e  stop tokenizing a subject once its filename and counter are known\n"
+            "  -f  tokenize the common kinds of subject with parsers of their own\n"
+            "  -F  report each file as its end tag is parsed (stdin is then parsed as it's read)\n"
+            "  -I  build an index of each NZB's files, segments and groups, and sum it up\n"
+            "  -j  process the files on this many threads (0: one per CPU)\n"
+            "  -J  split large files into pieces, parsed on this many threads (0: one per CPU)\n"
+            "  -p  extract subjects with the SIMD prefilter, falling back to the XML parser\n"
+            "  -r  print the counter and filename found in each subject\n"
+            "  -s  subjects only: skip over the segments of each file\n"
+            "  -S  print statistics for each file to stderr\n"
+            "  -t  learn a template from each file's subjects, and match the rest against it\n"
+            "reads stdin if no files are given\n",
+            myName);
+}
+
+int main(int argc, char * const argv[]) {
+    const char * myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    tParseFlags flags = kParse_Default;
+    int threads = 1;
+    int splitThreads = 1;
+    bool reportFiles = false;
+    bool indexFiles = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "befFIj:J:prsSt")) != -1) {
+        switch ( opt ) {
+        case 'b':
+            flags |= kParse_ByteWise;
+            break;
+
+        case 'e':
+            flags |= kParse_EarlyExit;
+            break;
+
+        case 'f':
+            flags |= kParse_Families;
+            break;
+
+        case 'F':
+            reportFiles = true;
+            break;
+
+        case 'I':
+            indexFiles = true;
+            break;
+
+        case 'j':
+            if ( !parseThreads(optarg, &threads)) {
+                usage(myName);
+                exit(EINVAL);
+            }
+            break;
+
+        case 'J':
+            if ( !parseThreads(optarg, &splitThreads)) {
+                usage(myName);
+                exit(EINVAL);
+            }
+            if ( splitThreads != 1 ) {
+                flags |= kParse_Split;
+            }
+            break;
+
+        case 'p':
+            flags |= kParse_Prefilter;
+            break;
+
+        case 'r':
+            flags |= kParse_Results;
+            break;
+
+        case 's':
+            flags |= kParse_SubjectsOnly;
+            break;
+
+        case 'S':
+            flags |= kParse_Statistics;
+            break;
+
+        case 't':
+            flags |= kParse_Templates;
+            break;
+
+        default:
+            usage(myName);
+            exit(EINVAL);
+        }
+    }
+
+    tOptions options = {
+        .flags = flags, .splitThreads = (unsigned int) splitThreads, .reportFiles = reportFiles, .indexFiles = indexFiles
+    };
+    if ( optind >= argc && (reportFiles || indexFiles) ) {
+        tDocument document;
+        tNzbIndex index;
+        prepareDocument(&document, &options, stdout, &index);
+        int result = streamInput(myName, &document, STDIN_FILENO);
+        finishDocument(&document);
+        if ( result < 0 && result != YXML_EEOF ) {
+            exit(result);
+        }
+        return 0;
+    }
+    if ( optind >= argc ) {
+        tInput input;
+        int result = readInput(&input, STDIN_FILENO);
+        if ( result != 0 ) {
+            fprintf(stderr,
+                    "### %s: error: unable to read stdin (%d: %s)\n",
+                    myName, result, strerror(result));
+            exit(-result);
+        }
+        tDocument document = { .flags = flags, .out = stdout, .threads = (unsigned int) splitThreads };
+        result = processInput(&document, input.data, input.length);
+        releaseDocument(&document);
+        releaseInput(&input);
+        if ( result < 0 && result != YXML_EEOF ) {
+            exit(result);
+        }
+        return 0;
+    }
+
+    size_t count = argc - optind;
+    tJob * jobs = calloc(count, sizeof(tJob));
+    if ( jobs == NULL) {
+        fprintf(stderr, "### %s: error: out of memory\n", myName);
+        exit(-ENOMEM);
+    }
+    for ( size_t i = 0; i < count; i++ ) {
+        jobs[ i ].path = argv[ optind + i ];
+    }
+
+    if ( threads == 1 || count == 1 ) {
+        /* stream straight to stdout */
+        for ( size_t i = 0; i < count; i++ ) {
+            runJob(&jobs[ i ], &options, stdout);
+            int status = finishJob(myName, &jobs[ i ]);
+            if ( status != 0 ) {
+                exit(status);
+            }
+        }
+    } else {
+        tBatch batch = {
+            .myName = myName, .options = options, .jobs = jobs, .done = calloc(count, sizeof(bool)), .count = count
+        };
+        if ( batch.done == NULL) {
+            fprintf(stderr, "### %s: error: out of memory\n", myName);
+            exit(-ENOMEM);
+        }
+        pthread_mutex_init(&batch.lock, NULL);
+
+        int result = runPool((unsigned int) threads, count, poolJob, &batch);
+        if ( result != 0 ) {
+            fprintf(stderr, "### %s: error: unable to start threads (%d: %s)\n",
+                    myName, result, strerror(result));
+            exit(-result);
+        }
+
+        pthread_mutex_destroy(&batch.lock);
+        free(batch.done);
+        if ( batch.failed != NULL) {
+            exit(finishJob(myName, batch.failed));
+        }
+    }
+    free(jobs);
+
+    return 0;
+}
@@ -0,0 +1,448 @@
+
+/*
+ * Times the stages of the pipeline one at a time, over the real subjects
+ * (and files) of a corpus, so a regression can be pinned on a stage:
+ *
+ *   hashString()        each subject
+ *   identifyToken()     each token of each subject
+ *   strrstr()           looking for " yEnc" in each subject
+ *   preprocessSubject() each subject (printing it to /dev/null)
+ *   processSubject()    each subject
+ *   yxml_parse()        each file, a byte at a time
+ *   digit loop          each number: bytes=, number= and date= attributes,
+ *                       and the digits in subjects, with isdigit() and a
+ *                       multiply per digit, as numbers used to be read
+ *   parseDecimal()      the same numbers, eight digits at a time
+ *
+ * Each stage gets a warm-up pass, then is run over all of its inputs for a
+ * number of passes; the fastest pass is reported, as time per call and
+ * cycles per byte (the time stamp counter on x86, so reference cycles).
+ *
+ *   nzb-micro-bench [-eft] [-n passes] [samples/ | file.nzb ...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <ctype.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define kHaveCycles  1
+#else
+#define kHaveCycles  0
+#endif
+
+#include "yxml.h"
+#include "nzb-subject.h"
+#include "nzb-bench.h"
+#include "nzb-scan.h"
+
+#define kDefaultPasses  50
+#define kDefaultCorpus  "samples"
+
+/* big enough for any NZB's nesting */
+#define kYxmlStack      4096
+
+/* a run of digits from a file or a subject, at offset in tInputs.digits */
+typedef struct {
+    size_t offset;
+    size_t length;
+} tNumber;
+
+typedef struct {
+    char       ** subjects;
+    size_t      * lengths;
+    size_t        count;
+    size_t        bytes;
+    tSubjectInfo * infos;       // each subject tokenized, for identifyToken()
+    size_t        tokenBytes;
+    size_t        tokenCount;
+    tCorpus       corpus;
+    size_t        corpusBytes;
+    tParseFlags   flags;        // for processSubject()
+    FILE        * devNull;
+    tNumber     * numbers;
+    size_t        numberCount;
+    size_t        numberCapacity;
+    byte        * digits;       // all of them, one after another, as the parser would have them in cache
+    size_t        numberBytes;
+    size_t        digitsSize;
+} tInputs;
+
+typedef struct {
+    const char * name;
+    size_t     (*run)(tInputs * inputs, uint64_t * sink);   // one pass, returning the calls made
+    size_t     (*bytes)(const tInputs * inputs);            // bytes covered by one pass
+} tStage;
+
+static const char * myName;
+
+/* results go here, so the compiler can't drop the calls */
+static volatile uint64_t sink;
+
+static inline uint64_t readCycles(void) {
+#if kHaveCycles
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "### %s: error: out of memory\n", myName);
+    exit(-ENOMEM);
+}
+
+static size_t subjectBytes(const tInputs * inputs) {
+    return inputs->bytes;
+}
+
+static size_t tokenBytes(const tInputs * inputs) {
+    return inputs->tokenBytes;
+}
+
+static size_t fileBytes(const tInputs * inputs) {
+    return inputs->corpusBytes;
+}
+
+static size_t numberBytes(const tInputs * inputs) {
+    return inputs->numberBytes;
+}
+
+static size_t runHashString(tInputs * inputs, uint64_t * result) {
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        *result += hashString((const unsigned char *) inputs->subjects[ i ], (int) inputs->lengths[ i ]);
+    }
+    return inputs->count;
+}
+
+static size_t runIdentifyToken(tInputs * inputs, uint64_t * result) {
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        const tSubjectInfo * info = &inputs->infos[ i ];
+        const byte * subject = (const byte *) inputs->subjects[ i ];
+        unsigned int count = info->tokenCount < kMaxSubjectTokens ? info->tokenCount : kMaxSubjectTokens;
+        for ( unsigned int t = 0; t < count; t++ ) {
+            *result += identifyToken(subject + info->tokens[ t ].span.offset, info->tokens[ t ].span.length);
+        }
+    }
+    return inputs->tokenCount;
+}
+
+static size_t runStrrstr(tInputs * inputs, uint64_t * result) {
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        *result += (uintptr_t) strrstr((unsigned char *) inputs->subjects[ i ], (const unsigned char *) " yEnc");
+    }
+    return inputs->count;
+}
+
+static size_t runPreprocessSubject(tInputs * inputs, uint64_t * result) {
+    tDocument document = { .flags = inputs->flags, .out = inputs->devNull, .threads = 1 };
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        *result += preprocessSubject(&document, (const byte *) inputs->subjects[ i ], inputs->lengths[ i ]);
+    }
+    return inputs->count;
+}
+
+static size_t runProcessSubject(tInputs * inputs, uint64_t * result) {
+    tDocument document = { .flags = inputs->flags, .out = inputs->devNull, .threads = 1 };
+    tSubjectInfo info;
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        processSubject(&document, (const byte *) inputs->subjects[ i ], inputs->lengths[ i ], &info);
+        *result += info.tokenCount;
+    }
+    releaseDocument(&document);
+    return inputs->count;
+}
+
+static size_t runYxmlParse(tInputs * inputs, uint64_t * result) {
+    static char stack[ kYxmlStack ];
+    yxml_t xml;
+
+    for ( size_t i = 0; i < inputs->corpus.count; i++ ) {
+        const tCorpusFile * file = &inputs->corpus.files[ i ];
+        yxml_init(&xml, stack, sizeof(stack));
+        for ( size_t j = 0; j < file->length; j++ ) {
+            yxml_ret_t r = yxml_parse(&xml, file->data[ j ]);
+            if ( r < 0 ) {
+                break;
+            }
+            *result += r;
+        }
+    }
+    return inputs->corpus.count;
+}
+
+/** how numbers were read before parseDecimal() */
+static size_t digitLoop(const byte * p, const byte * end, uint64_t * value) {
+    const byte * start = p;
+    uint64_t result = 0;
+    for ( ; p < end && isdigit(*p); p++ ) {
+        result = result * 10 + (*p - '0');
+    }
+    *value = result;
+    return p - start;
+}
+
+/* as in the parser, each number is followed by more of the document */
+static size_t runDigitLoop(tInputs * inputs, uint64_t * result) {
+    const byte * end = inputs->digits + inputs->numberBytes + inputs->numberCount;
+    for ( size_t i = 0; i < inputs->numberCount; i++ ) {
+        const byte * digits = inputs->digits + inputs->numbers[ i ].offset;
+        uint64_t value;
+        *result += digitLoop(digits, end, &value) + value;
+    }
+    return inputs->numberCount;
+}
+
+static size_t runParseDecimal(tInputs * inputs, uint64_t * result) {
+    const byte * end = inputs->digits + inputs->numberBytes + inputs->numberCount;
+    for ( size_t i = 0; i < inputs->numberCount; i++ ) {
+        const byte * digits = inputs->digits + inputs->numbers[ i ].offset;
+        uint64_t value;
+        *result += parseDecimal(digits, end, &value) + value;
+    }
+    return inputs->numberCount;
+}
+
+static const tStage stages[] = {
+    { "hashString",        runHashString,        subjectBytes },
+    { "identifyToken",     runIdentifyToken,     tokenBytes },
+    { "strrstr",           runStrrstr,           subjectBytes },
+    { "preprocessSubject", runPreprocessSubject, subjectBytes },
+    { "processSubject",    runProcessSubject,    subjectBytes },
+    { "yxml_parse",        runYxmlParse,         fileBytes },
+    { "digit loop",        runDigitLoop,         numberBytes },
+    { "parseDecimal",      runParseDecimal,      numberBytes },
+};
+
+static void addNumber(tInputs * inputs, const byte * digits, size_t length) {
+    if ( inputs->numberCount == inputs->numberCapacity ) {
+        inputs->numberCapacity = inputs->numberCapacity == 0 ? 1024 : inputs->numberCapacity * 2;
+        inputs->numbers = realloc(inputs->numbers, inputs->numberCapacity * sizeof(tNumber));
+        if ( inputs->numbers == NULL) {
+            outOfMemory();
+        }
+    }
+    /* each is followed by a space, as a number would be by a quote or a '/' */
+    if ( inputs->numberBytes + inputs->numberCount + length + 1 > inputs->digitsSize ) {
+        inputs->digitsSize = inputs->digitsSize == 0 ? 64 * 1024 : inputs->digitsSize * 2;
+        inputs->digits = realloc(inputs->digits, inputs->digitsSize);
+        if ( inputs->digits == NULL) {
+            outOfMemory();
+        }
+    }
+    size_t offset = inputs->numberBytes + inputs->numberCount;
+    memcpy(inputs->digits + offset, digits, length);
+    inputs->digits[ offset + length ] = ' ';
+    inputs->numbers[ inputs->numberCount++ ] = (tNumber) { offset, length };
+    inputs->numberBytes += length;
+}
+
+/** gather the values of every attribute called name in the file */
+static void addAttributeNumbers(tInputs * inputs, const tCorpusFile * file, const char * name) {
+    const byte * end = file->data + file->length;
+    size_t nameLength = strlen(name);
+    for ( const byte * p = file->data; (p = findString(p, end, name, nameLength)) != NULL; ) {
+        p += nameLength;
+        const byte * digits = p;
+        while ( p < end && *p >= '0' && *p <= '9' ) p++;
+        if ( p > digits ) {
+            addNumber(inputs, digits, p - digits);
+        }
+    }
+}
+
+/** gather the numbers that are read from each file, and each subject */
+static void prepareNumbers(tInputs * inputs) {
+    for ( size_t f = 0; f < inputs->corpus.count; f++ ) {
+        addAttributeNumbers(inputs, &inputs->corpus.files[ f ], " bytes=\"");
+        addAttributeNumbers(inputs, &inputs->corpus.files[ f ], " number=\"");
+        addAttributeNumbers(inputs, &inputs->corpus.files[ f ], " date=\"");
+    }
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        const byte * p = (const byte *) inputs->subjects[ i ];
+        const byte * end = p + inputs->lengths[ i ];
+        while ( p < end ) {
+            const byte * digits = p;
+            while ( p < end && *p >= '0' && *p <= '9' ) p++;
+            if ( p > digits ) {
+                addNumber(inputs, digits, p - digits);
+            } else {
+                p++;
+            }
+        }
+    }
+}
+
+/** gather the subjects of every file, and tokenize each once for identifyToken() */
+static void prepareInputs(tInputs * inputs) {
+    size_t capacity = 0;
+
+    for ( size_t f = 0; f < inputs->corpus.count; f++ ) {
+        tCorpusFile * file = &inputs->corpus.files[ f ];
+        char ** subjects;
+        int result = captureSubjects(file, kParse_Default, 1, &subjects);
+        if ( result < 0 ) {
+            fprintf(stderr, "### %s: error: unable to process \'%s\' (%d)\n", myName, file->path, result);
+            exit(result);
+        }
+        inputs->corpusBytes += file->length;
+
+        for ( size_t i = 0; i < file->subjects; i++ ) {
+            if ( inputs->count == capacity ) {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+                inputs->subjects = realloc(inputs->subjects, capacity * sizeof(char *));
+                inputs->lengths = realloc(inputs->lengths, capacity * sizeof(size_t));
+                if ( inputs->subjects == NULL || inputs->lengths == NULL) {
+                    outOfMemory();
+                }
+            }
+            inputs->subjects[ inputs->count ] = subjects[ i ];
+            inputs->lengths[ inputs->count ] = strlen(subjects[ i ]);
+            inputs->bytes += inputs->lengths[ inputs->count ];
+            inputs->count++;
+        }
+        free(subjects);
+    }
+
+    inputs->infos = calloc(inputs->count > 0 ? inputs->count : 1, sizeof(tSubjectInfo));
+    if ( inputs->infos == NULL) {
+        outOfMemory();
+    }
+    for ( size_t i = 0; i < inputs->count; i++ ) {
+        tSubjectInfo * info = &inputs->infos[ i ];
+        const byte * subject = (const byte *) inputs->subjects[ i ];
+        info->trimmed = (tSpan) { 0, (unsigned int) trimSubject(subject, inputs->lengths[ i ]) };
+        tokenizeSubject(subject, info, kParse_Default);
+
+        unsigned int count = info->tokenCount < kMaxSubjectTokens ? info->tokenCount : kMaxSubjectTokens;
+        for ( unsigned int t = 0; t < count; t++ ) {
+            inputs->tokenBytes += info->tokens[ t ].span.length;
+        }
+        inputs->tokenCount += count;
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: %s [-eft] [-n passes] [directory | file.nzb ...]\n"
+            "  -e -f -t  as for nzb-subject, for processSubject()\n"
+            "  -n  how many passes to time each stage over (default %d)\n"
+            "the corpus defaults to the files in %s/\n",
+            myName, kDefaultPasses, kDefaultCorpus);
+}
+
+int main(int argc, char * const argv[]) {
+    myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    tInputs inputs;
+    memset(&inputs, 0, sizeof(inputs));
+    int passes = kDefaultPasses;
+    int opt;
+    while ((opt = getopt(argc, argv, "efn:t")) != -1) {
+        switch ( opt ) {
+        case 'e':
+            inputs.flags |= kParse_EarlyExit;
+            break;
+
+        case 'f':
+            inputs.flags |= kParse_Families;
+            break;
+
+        case 't':
+            inputs.flags |= kParse_Templates;
+            break;
+
+        case 'n':
+            passes = atoi(optarg);
+            if ( passes < 1 ) {
+                usage();
+                exit(EINVAL);
+            }
+            break;
+
+        default:
+            usage();
+            exit(EINVAL);
+        }
+    }
+
+    const char * const * paths = (const char * const *) &argv[ optind ];
+    int pathCount = argc - optind;
+    const char * defaultPath = kDefaultCorpus;
+    if ( pathCount == 0 ) {
+        paths = &defaultPath;
+        pathCount = 1;
+    }
+    for ( int i = 0; i < pathCount; i++ ) {
+        int error = loadCorpus(&inputs.corpus, paths[ i ]);
+        if ( error != 0 ) {
+            fprintf(stderr, "### %s: error: unable to load \'%s\' (%d: %s)\n",
+                    myName, paths[ i ], error, strerror(error));
+            exit(-error);
+        }
+    }
+
+    inputs.devNull = fopen("/dev/null", "w");
+    if ( inputs.devNull == NULL) {
+        fprintf(stderr, "### %s: error: unable to open /dev/null (%d: %s)\n", myName, errno, strerror(errno));
+        exit(-errno);
+    }
+    prepareInputs(&inputs);
+    prepareNumbers(&inputs);
+
+    printf("%zu files (%zu bytes), %zu subjects (%zu bytes), %zu tokens, %zu numbers, best of %d passes\n",
+           inputs.corpus.count, inputs.corpusBytes, inputs.count, inputs.bytes, inputs.tokenCount,
+           inputs.numberCount, passes);
+    printf("%-18s %9s %10s %11s %12s %11s\n", "stage", "calls", "bytes", "ns/call", "ns/byte", "cycles/byte");
+
+    for ( size_t s = 0; s < sizeof(stages) / sizeof(stages[ 0 ]); s++ ) {
+        const tStage * stage = &stages[ s ];
+        uint64_t result = 0;
+        uint64_t bestNanoseconds = UINT64_MAX;
+        uint64_t bestCycles = UINT64_MAX;
+        size_t calls = stage->run(&inputs, &result);    // warm up
+
+        for ( int p = 0; p < passes; p++ ) {
+            uint64_t start = benchNanoseconds();
+            uint64_t startCycles = readCycles();
+            stage->run(&inputs, &result);
+            uint64_t cycles = readCycles() - startCycles;
+            uint64_t nanoseconds = benchNanoseconds() - start;
+
+            if ( nanoseconds < bestNanoseconds ) bestNanoseconds = nanoseconds;
+            if ( cycles < bestCycles ) bestCycles = cycles;
+        }
+        fflush(inputs.devNull);
+        sink += result;
+
+        size_t bytes = stage->bytes(&inputs);
+        double perByte = bytes > 0 ? (double) bestNanoseconds / bytes : 0.0;
+        printf("%-18s %9zu %10zu %11.1f %12.3f ", stage->name, calls, bytes,
+               calls > 0 ? (double) bestNanoseconds / calls : 0.0, perByte);
+        if ( kHaveCycles && bytes > 0 ) {
+            printf("%11.3f\n", (double) bestCycles / bytes);
+        } else {
+            printf("%11s\n", "-");
+        }
+    }
+
+    fclose(inputs.devNull);
+    for ( size_t i = 0; i < inputs.count; i++ ) {
+        free(inputs.subjects[ i ]);
+    }
+    free(inputs.subjects);
+    free(inputs.lengths);
+    free(inputs.infos);
+    free(inputs.numbers);
+    free(inputs.digits);
+    releaseCorpus(&inputs.corpus);
+    return 0;
+}
@@ -0,0 +1,155 @@
+
+#include <stdlib.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "nzb-pool.h"
+
+/* the tasks a worker still has to do: [next, end). The owner takes from
+ * the front, thieves take from the back. Tasks are whole NZB files, so
+ * a mutex per deque costs nothing measurable. */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} tDeque;
+
+typedef struct sPool tPool;
+
+typedef struct {
+    tPool * pool;
+    unsigned int index;
+    pthread_t thread;
+} tWorker;
+
+struct sPool {
+    unsigned int  count;
+    tDeque      * deques;
+    tWorker     * workers;
+    tTaskFunction task;
+    void        * context;
+};
+
+static bool takeFront(tDeque * deque, size_t * index) {
+    bool result = false;
+    pthread_mutex_lock(&deque->lock);
+    if ( deque->next < deque->end ) {
+        *index = deque->next++;
+        result = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return result;
+}
+
+static bool takeBack(tDeque * deque, size_t * index) {
+    bool result = false;
+    pthread_mutex_lock(&deque->lock);
+    if ( deque->next < deque->end ) {
+        *index = --deque->end;
+        result = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return result;
+}
+
+/**
+ * steal a task from whichever other worker has the most left.
+ */
+static bool steal(tPool * pool, unsigned int thief, size_t * index) {
+    for (;;) {
+        unsigned int victim = thief;
+        size_t most = 0;
+
+        for ( unsigned int i = 0; i < pool->count; i++ ) {
+            if ( i == thief ) continue;
+
+            tDeque * deque = &pool->deques[ i ];
+            pthread_mutex_lock(&deque->lock);
+            size_t left = deque->end - deque->next;
+            pthread_mutex_unlock(&deque->lock);
+
+            if ( left > most ) {
+                most = left;
+                victim = i;
+            }
+        }
+        if ( most == 0 ) {
+            return false;
+        }
+        if ( takeBack(&pool->deques[ victim ], index)) {
+            return true;
+        }
+        /* lost a race for the last one, look again */
+    }
+}
+
+static void * workerMain(void * argument) {
+    tWorker * worker = argument;
+    tPool * pool = worker->pool;
+    size_t index;
+
+    while ( takeFront(&pool->deques[ worker->index ], &index)
+            || steal(pool, worker->index, &index)) {
+        pool->task(pool->context, index, worker->index);
+    }
+    return NULL;
+}
+
+int runPool(unsigned int workers, size_t count, tTaskFunction task, void * context) {
+    if ( workers == 0 ) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned int) cpus : 1;
+    }
+    if ( workers > count ) {
+        workers = count > 0 ? (unsigned int) count : 1;
+    }
+
+    tPool pool = { workers, NULL, NULL, task, context };
+    pool.deques = calloc(workers, sizeof(tDeque));
+    pool.workers = calloc(workers, sizeof(tWorker));
+    if ( pool.deques == NULL || pool.workers == NULL) {
+        free(pool.deques);
+        free(pool.workers);
+        return ENOMEM;
+    }
+
+    /* hand out contiguous slices, the first ones getting any remainder */
+    size_t start = 0;
+    for ( unsigned int i = 0; i < workers; i++ ) {
+        size_t share = count / workers + (i < count % workers ? 1 : 0);
+        pthread_mutex_init(&pool.deques[ i ].lock, NULL);
+        pool.deques[ i ].next = start;
+        pool.deques[ i ].end = start + share;
+        start += share;
+    }
+
+    unsigned int started = 0;
+    while ( started < workers ) {
+        pool.workers[ started ].pool = &pool;
+        pool.workers[ started ].index = started;
+        if ( pthread_create(&pool.workers[ started ].thread, NULL, workerMain, &pool.workers[ started ]) != 0 ) {
+            break;
+        }
+        started++;
+    }
+
+    if ( started == 0 ) {
+        /* no threads at all, do it ourselves */
+        tWorker self = { .pool = &pool, .index = 0 };
+        workerMain(&self);
+    } else {
+        /* the slices of any threads that failed to start get stolen by the others */
+        for ( unsigned int i = 0; i < started; i++ ) {
+            pthread_join(pool.workers[ i ].thread, NULL);
+        }
+    }
+
+    for ( unsigned int i = 0; i < workers; i++ ) {
+        pthread_mutex_destroy(&pool.deques[ i ].lock);
+    }
+    free(pool.deques);
+    free(pool.workers);
+    return 0;
+}
@@ -0,0 +1,24 @@
+
+#ifndef NZB_POOL_H
+#define NZB_POOL_H
+
+#include <stddef.h>
+
+/**
+ * run one task, identified by its index, on the given worker thread.
+ */
+typedef void (*tTaskFunction)(void * context, size_t index, unsigned int worker);
+
+/**
+ * run tasks 0 .. count-1 on a pool of worker threads, and wait for all of them.
+ *
+ * Each worker starts out owning a contiguous slice of the indices and works
+ * through it front to back, so with ordered output the earliest results
+ * become available first. A worker that runs out steals from the back of
+ * the busiest remaining slice, so one huge NZB doesn't hold the rest up.
+ * @param workers number of threads; 0 means one per online CPU
+ * @return 0 on success, otherwise an errno value (no tasks have run)
+ */
+int runPool(unsigned int workers, size_t count, tTaskFunction task, void * context);
+
+#endif
@@ -0,0 +1,257 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nzb-prefilter.h"
+#include "nzb-scan.h"
+
+/* subjects are collected first and only processed once the whole document
+ * has been scanned successfully, so giving up never leaves the caller with
+ * half of the subjects already processed */
+typedef struct {
+    const byte * borrowed;  // the subject as it is in the document, or NULL if it had to be decoded
+    size_t       offset;    // if decoded, where it is in the list's text
+    size_t       length;
+} tSubjectRef;
+
+typedef struct {
+    byte        * text;     // the subjects that had to be decoded
+    size_t        length;
+    size_t        size;
+    tSubjectRef * subjects;
+    unsigned int  count;
+    unsigned int  capacity;
+} tSubjectList;
+
+static bool addRef(tSubjectList * list, const byte * borrowed, size_t offset, size_t length) {
+    if ( list->count == list->capacity ) {
+        unsigned int capacity = list->capacity ? list->capacity * 2 : 256;
+        tSubjectRef * subjects = realloc(list->subjects, capacity * sizeof(tSubjectRef));
+        if ( subjects == NULL) {
+            return false;
+        }
+        list->subjects = subjects;
+        list->capacity = capacity;
+    }
+    tSubjectRef * ref = &list->subjects[ list->count++ ];
+    ref->borrowed = borrowed;
+    ref->offset = offset;
+    ref->length = length;
+    return true;
+}
+
+static bool reserve(tSubjectList * list, size_t extra) {
+    if ( list->length + extra > list->size ) {
+        size_t size = list->size ? list->size : 4096;
+        while ( size < list->length + extra ) size *= 2;
+
+        byte * text = realloc(list->text, size);
+        if ( text == NULL) {
+            return false;
+        }
+        list->text = text;
+        list->size = size;
+    }
+    return true;
+}
+
+/* same encoding as yxml_setutf8() */
+static byte * putUTF8(byte * d, uint32_t ch) {
+    if ( ch <= 0x7F ) {
+        *d++ = ch;
+    } else if ( ch <= 0x7FF ) {
+        *d++ = 0xC0 | (ch >> 6);
+        *d++ = 0x80 | (ch & 0x3F);
+    } else if ( ch <= 0xFFFF ) {
+        *d++ = 0xE0 | (ch >> 12);
+        *d++ = 0x80 | ((ch >> 6) & 0x3F);
+        *d++ = 0x80 | (ch & 0x3F);
+    } else {
+        *d++ = 0xF0 | (ch >> 18);
+        *d++ = 0x80 | ((ch >> 12) & 0x3F);
+        *d++ = 0x80 | ((ch >> 6) & 0x3F);
+        *d++ = 0x80 | (ch & 0x3F);
+    }
+    return d;
+}
+
+/**
+ * decode the reference between '&' and ';' in [start, end).
+ * Accepts exactly what yxml accepts: the five predefined entities and
+ * decimal or hex character references to valid XML characters.
+ * @return the character, or 0 if yxml would reject it
+ */
+static uint32_t decodeReference(const byte * start, const byte * end) {
+    size_t len = end - start;
+    uint32_t ch = 0;
+
+    /* yxml has room for seven characters between '&' and ';' */
+    if ( len > 7 ) return 0;
+
+    if ( len > 1 && start[ 0 ] == '#' ) {
+        const byte * p = start + 1;
+        if ( *p == 'x' ) {
+            if ( ++p == end ) return 0;
+            for ( ; p < end; p++ ) {
+                if ( *p >= '0' && *p <= '9' ) ch = (ch << 4) + (*p - '0');
+                else if ( (*p | 32) >= 'a' && (*p | 32) <= 'f' ) ch = (ch << 4) + ((*p | 32) - 'a' + 10);
+                else return 0;
+                if ( ch > 0x10FFFF ) return 0;
+            }
+        } else {
+            uint64_t value;
+            if ( parseDecimal(p, end, &value) != (size_t) (end - p) || value > 0x10FFFF ) return 0;
+            ch = (uint32_t) value;
+        }
+        if ( ch == 0xFFFE || ch == 0xFFFF || (ch >= 0xD800 && ch <= 0xDFFF)) return 0;
+        return ch;
+    }
+
+    switch ( len ) {
+    case 2:
+        if ( memcmp(start, "lt", 2) == 0 ) return '<';
+        if ( memcmp(start, "gt", 2) == 0 ) return '>';
+        break;
+    case 3:
+        if ( memcmp(start, "amp", 3) == 0 ) return '&';
+        break;
+    case 4:
+        if ( memcmp(start, "apos", 4) == 0 ) return '\'';
+        if ( memcmp(start, "quot", 4) == 0 ) return '"';
+        break;
+    }
+    return 0;
+}
+
+/**
+ * append the attribute value in [p, end) to the list, decoded and
+ * normalized the same way yxml does it. Most subjects need neither, and
+ * are used right where they are in the document.
+ * @return false if the value contains something yxml would reject
+ */
+static bool addSubject(tSubjectList * list, const byte * p, const byte * end) {
+    const byte * q = p;
+    while ( q < end && *q != '&' && *q != '\r' && *q != '\n' && *q != '\t' && *q != '<' && *q != '\0' ) q++;
+    if ( q == end ) {
+        return addRef(list, p, 0, end - p);
+    }
+
+    /* decoding never makes a value longer */
+    if ( !reserve(list, end - p)) {
+        return false;
+    }
+    byte * d = &list->text[ list->length ];
+    byte * start = d;
+
+    while ( p < end ) {
+        byte c = *p++;
+        switch ( c ) {
+        case '&': {
+            const byte * semi = memchr(p, ';', end - p);
+            if ( semi == NULL) return false;
+
+            uint32_t ch = decodeReference(p, semi);
+            if ( ch == 0 ) return false;
+
+            d = putUTF8(d, ch);
+            p = semi + 1;
+            break;
+        }
+
+        case '\r':
+            /* "\r\n" is a single line ending */
+            if ( p < end && *p == '\n' ) p++;
+            /* fall through */
+        case '\n':
+        case '\t':
+            *d++ = ' ';
+            break;
+
+        case '<':
+        case '\0':
+            return false;
+
+        default:
+            *d++ = c;
+            break;
+        }
+    }
+    list->length = d - list->text;
+    return addRef(list, NULL, start - list->text, d - start);
+}
+
+/**
+ * scan the attributes of the start tag that begins at p (just past '<file').
+ * @return a pointer past the end of the tag, or NULL if it's malformed
+ */
+static const byte * scanFileTag(tSubjectList * list, const byte * p, const byte * end) {
+    for (;;) {
+        while ( p < end && isXmlSpace(*p)) p++;
+        if ( p >= end ) return NULL;
+
+        if ( *p == '>' ) return p + 1;
+        if ( *p == '/' ) return (p + 1 < end && p[ 1 ] == '>') ? p + 2 : NULL;
+
+        const byte * name = p;
+        while ( p < end && !isXmlSpace(*p) && *p != '=' && *p != '>' && *p != '/' ) p++;
+        size_t nameLen = p - name;
+
+        while ( p < end && isXmlSpace(*p)) p++;
+        if ( p >= end || *p != '=' ) return NULL;
+        p++;
+        while ( p < end && isXmlSpace(*p)) p++;
+        if ( p >= end || (*p != '"' && *p != '\'')) return NULL;
+
+        byte quote = *p++;
+        const byte * value = p;
+        p = memchr(value, quote, end - value);
+        if ( p == NULL) return NULL;
+
+        if ( nameLen == 7 && memcmp(name, "subject", 7) == 0 ) {
+            if ( !addSubject(list, value, p)) return NULL;
+        }
+        p++;
+
+        /* yxml wants a separator between attributes */
+        if ( p < end && !isXmlSpace(*p) && *p != '>' && *p != '/' ) return NULL;
+    }
+}
+
+int prefilterFile(tDocument * document, const byte * data, size_t length) {
+    const byte * end = data + length;
+    const byte * p = data;
+    tSubjectList list = { 0 };
+    int result = 0;
+
+    /* a single SIMD pass finds both the file tags and anything that could hide one */
+    while ((p = findMarkup(p, end, "f!?")) != NULL) {
+        if ( p[ 1 ] == 'f' ) {
+            if ( end - p > 5 && memcmp(p, "<file", 5) == 0 && isXmlSpace(p[ 5 ])) {
+                p = scanFileTag(&list, p + 5, end);
+            } else {
+                p += 2;
+            }
+        } else {
+            p = skipMarkup(p, end);
+        }
+
+        if ( p == NULL) {
+            result = -1;
+            break;
+        }
+    }
+
+    if ( result == 0 ) {
+        for ( unsigned int i = 0; i < list.count; i++ ) {
+            const tSubjectRef * ref = &list.subjects[ i ];
+            tSubjectInfo info;
+            processSubject(document, ref->borrowed ? ref->borrowed : list.text + ref->offset, ref->length, &info);
+        }
+    }
+
+    free(list.text);
+    free(list.subjects);
+    return result;
+}
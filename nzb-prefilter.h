@@ -0,0 +1,21 @@
+
+#ifndef NZB_PREFILTER_H
+#define NZB_PREFILTER_H
+
+#include "nzb-subject.h"
+
+/**
+ * extract the subject of every <file> straight from the raw NZB bytes, without
+ * running the XML parser, and hand each one to processSubject().
+ *
+ * Only the '<file ' start tags are looked at; everything in between (the
+ * segments, which are the bulk of an NZB) is skipped with a SIMD scan. The
+ * document isn't validated. Anything the prefilter can't be sure about (a
+ * comment or CDATA section that could hide or fake a <file> tag, an unknown
+ * entity, a malformed start tag) makes it give up *before* any subject is
+ * processed, so the caller can fall back to processFile().
+ * @return 0 on success, -1 if the document has to be parsed by yxml instead
+ */
+int prefilterFile(tDocument * document, const byte * data, size_t length);
+
+#endif
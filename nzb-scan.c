@@ -0,0 +1,322 @@
+
+#include <string.h>
+
+#if defined(__AVX2__) && defined(__GNUC__)
+#include <immintrin.h>
+#elif defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
+
+#include "nzb-scan.h"
+
+/* With AVX2 (e.g. -DNZB_SUBJECT_NATIVE=ON on a recent x86) the scans below
+ * look at 32 positions per step, then finish with 16 at a time, then bytes. */
+
+const unsigned char * findString(const unsigned char * haystack, const unsigned char * end,
+                                 const char * needle, size_t needleLen) {
+    if ( needleLen == 0 ) {
+        return haystack;
+    }
+    if ( haystack > end || (size_t) (end - haystack) < needleLen ) {
+        return NULL;
+    }
+
+    const unsigned char * p = haystack;
+    /* last position a match can start at */
+    const unsigned char * last = end - needleLen;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+    const __m256i first32 = _mm256_set1_epi8(needle[ 0 ]);
+    const __m256i final32 = _mm256_set1_epi8(needle[ needleLen - 1 ]);
+
+    while ( last - p >= 32 ) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + needleLen - 1));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, first32), _mm256_cmpeq_epi8(b, final32)));
+
+        while ( mask != 0 ) {
+            unsigned bit = __builtin_ctz(mask);
+            if ( memcmp(p + bit + 1, needle + 1, needleLen - 1) == 0 ) {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+    const __m128i first = _mm_set1_epi8(needle[ 0 ]);
+    const __m128i final = _mm_set1_epi8(needle[ needleLen - 1 ]);
+
+    /* both loads must stay inside the haystack */
+    while ( last - p >= 16 ) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + needleLen - 1));
+        unsigned mask = (unsigned) _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+
+        while ( mask != 0 ) {
+            unsigned bit = __builtin_ctz(mask);
+            if ( memcmp(p + bit + 1, needle + 1, needleLen - 1) == 0 ) {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+#endif
+
+    for ( ; p <= last; p++ ) {
+        p = memchr(p, needle[ 0 ], last - p + 1);
+        if ( p == NULL) {
+            return NULL;
+        }
+        if ( memcmp(p + 1, needle + 1, needleLen - 1) == 0 ) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+const unsigned char * findLastString(const unsigned char * haystack, const unsigned char * end,
+                                     const char * needle, size_t needleLen) {
+    if ( haystack > end || (size_t) (end - haystack) < needleLen ) {
+        return NULL;
+    }
+    if ( needleLen == 0 ) {
+        return end;
+    }
+
+    /* candidate starts still to check are [0, i), working down */
+    size_t i = (size_t) (end - haystack) - needleLen + 1;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+    const __m256i first32 = _mm256_set1_epi8(needle[ 0 ]);
+    const __m256i final32 = _mm256_set1_epi8(needle[ needleLen - 1 ]);
+
+    while ( i >= 32 ) {
+        const unsigned char * p = haystack + i - 32;
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + needleLen - 1));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, first32), _mm256_cmpeq_epi8(b, final32)));
+
+        /* highest candidate first */
+        while ( mask != 0 ) {
+            unsigned bit = 31 - __builtin_clz(mask);
+            if ( memcmp(p + bit + 1, needle + 1, needleLen - 1) == 0 ) {
+                return p + bit;
+            }
+            mask ^= 1u << bit;
+        }
+        i -= 32;
+    }
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+    const __m128i first = _mm_set1_epi8(needle[ 0 ]);
+    const __m128i final = _mm_set1_epi8(needle[ needleLen - 1 ]);
+
+    while ( i >= 16 ) {
+        const unsigned char * p = haystack + i - 16;
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + needleLen - 1));
+        unsigned mask = (unsigned) _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+
+        while ( mask != 0 ) {
+            unsigned bit = 31 - __builtin_clz(mask);
+            if ( memcmp(p + bit + 1, needle + 1, needleLen - 1) == 0 ) {
+                return p + bit;
+            }
+            mask ^= 1u << bit;
+        }
+        i -= 16;
+    }
+#endif
+
+    while ( i-- > 0 ) {
+        if ( haystack[ i ] == (unsigned char) needle[ 0 ]
+             && memcmp(haystack + i + 1, needle + 1, needleLen - 1) == 0 ) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+const unsigned char * findMarkup(const unsigned char * haystack, const unsigned char * end,
+                                 const char * next) {
+    size_t count = strlen(next);
+    if ( count == 0 || count > 4 || haystack >= end ) {
+        return NULL;
+    }
+
+    const unsigned char * p = haystack;
+    const unsigned char * last = end - 1;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+    const __m256i lt32 = _mm256_set1_epi8('<');
+    const __m256i m0 = _mm256_set1_epi8(next[ 0 ]);
+    const __m256i m1 = _mm256_set1_epi8(next[ count > 1 ? 1 : 0 ]);
+    const __m256i m2 = _mm256_set1_epi8(next[ count > 2 ? 2 : 0 ]);
+    const __m256i m3 = _mm256_set1_epi8(next[ count > 3 ? 3 : 0 ]);
+
+    while ( last - p >= 32 ) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + 1));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(b, m0), _mm256_cmpeq_epi8(b, m1)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(b, m2), _mm256_cmpeq_epi8(b, m3)));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, lt32), any));
+        if ( mask != 0 ) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+    const __m128i lt = _mm_set1_epi8('<');
+    /* unused slots repeat the first character */
+    const __m128i n0 = _mm_set1_epi8(next[ 0 ]);
+    const __m128i n1 = _mm_set1_epi8(next[ count > 1 ? 1 : 0 ]);
+    const __m128i n2 = _mm_set1_epi8(next[ count > 2 ? 2 : 0 ]);
+    const __m128i n3 = _mm_set1_epi8(next[ count > 3 ? 3 : 0 ]);
+
+    while ( last - p >= 16 ) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(b, n0), _mm_cmpeq_epi8(b, n1)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(b, n2), _mm_cmpeq_epi8(b, n3)));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, lt), any));
+        if ( mask != 0 ) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+
+    for ( ; p < last; p++ ) {
+        p = memchr(p, '<', last - p);
+        if ( p == NULL) {
+            return NULL;
+        }
+        if ( memchr(next, p[ 1 ], count) != NULL) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* a '<' followed by this starts a comment, CDATA section, DOCTYPE or processing instruction */
+static inline bool isMarkup(unsigned char c) {
+    return c == '!' || c == '?';
+}
+
+const unsigned char * findTagOrMarkup(const unsigned char * haystack, const unsigned char * end,
+                                      const char * tag, size_t tagLen) {
+    if ( tagLen < 2 || tag[ 0 ] != '<' || haystack >= end || end - haystack < 2 ) {
+        return NULL;
+    }
+
+    const unsigned char * p = haystack;
+    /* last position the tag can start at, and the last a '<' can be followed at */
+    const unsigned char * lastTag = (size_t) (end - haystack) >= tagLen ? end - tagLen : NULL;
+    const unsigned char * last = end - 1;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+    const __m256i lt32 = _mm256_set1_epi8('<');
+    const __m256i second32 = _mm256_set1_epi8(tag[ 1 ]);
+    const __m256i final32 = _mm256_set1_epi8(tag[ tagLen - 1 ]);
+    const __m256i bang32 = _mm256_set1_epi8('!');
+    const __m256i question32 = _mm256_set1_epi8('?');
+
+    while ( lastTag != NULL && lastTag - p >= 32 ) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + 1));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (p + tagLen - 1));
+        __m256i markup = _mm256_or_si256(_mm256_cmpeq_epi8(b, bang32), _mm256_cmpeq_epi8(b, question32));
+        __m256i maybeTag = _mm256_and_si256(_mm256_cmpeq_epi8(b, second32), _mm256_cmpeq_epi8(c, final32));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, lt32), _mm256_or_si256(markup, maybeTag)));
+
+        while ( mask != 0 ) {
+            const unsigned char * q = p + __builtin_ctz(mask);
+            if ( isMarkup(q[ 1 ]) || memcmp(q + 2, tag + 2, tagLen - 2) == 0 ) {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i second = _mm_set1_epi8(tag[ 1 ]);
+    const __m128i final = _mm_set1_epi8(tag[ tagLen - 1 ]);
+    const __m128i bang = _mm_set1_epi8('!');
+    const __m128i question = _mm_set1_epi8('?');
+
+    /* all three loads must stay inside the haystack */
+    while ( lastTag != NULL && lastTag - p >= 16 ) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i c = _mm_loadu_si128((const __m128i *) (p + tagLen - 1));
+        __m128i markup = _mm_or_si128(_mm_cmpeq_epi8(b, bang), _mm_cmpeq_epi8(b, question));
+        __m128i maybeTag = _mm_and_si128(_mm_cmpeq_epi8(b, second), _mm_cmpeq_epi8(c, final));
+        unsigned mask = (unsigned) _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, lt), _mm_or_si128(markup, maybeTag)));
+
+        while ( mask != 0 ) {
+            const unsigned char * q = p + __builtin_ctz(mask);
+            if ( isMarkup(q[ 1 ]) || memcmp(q + 2, tag + 2, tagLen - 2) == 0 ) {
+                return q;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+#endif
+
+    for ( ; p < last; p++ ) {
+        p = memchr(p, '<', last - p);
+        if ( p == NULL) {
+            return NULL;
+        }
+        if ( isMarkup(p[ 1 ])
+             || (lastTag != NULL && p <= lastTag && memcmp(p + 1, tag + 1, tagLen - 1) == 0)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * skip over the comment, CDATA section, processing instruction or DOCTYPE at p,
+ * so a '<file' inside one of them is neither missed nor mistaken for a real one.
+ * @return a pointer past its end, or NULL if we can't tell where it ends
+ */
+const unsigned char * skipMarkup(const unsigned char * p, const unsigned char * end) {
+    const unsigned char * close;
+    size_t left = end - p;
+
+    if ( left >= 4 && memcmp(p, "<!--", 4) == 0 ) {
+        close = findString(p + 4, end, "-->", 3);
+        return close ? close + 3 : NULL;
+    }
+    if ( left >= 9 && memcmp(p, "<![CDATA[", 9) == 0 ) {
+        close = findString(p + 9, end, "]]>", 3);
+        return close ? close + 3 : NULL;
+    }
+    if ( left >= 9 && memcmp(p, "<!DOCTYPE", 9) == 0 ) {
+        /* an internal subset could declare entities we know nothing about */
+        close = memchr(p, '>', left);
+        if ( close == NULL || memchr(p, '[', close - p) != NULL) {
+            return NULL;
+        }
+        return close + 1;
+    }
+    if ( left >= 2 && p[ 1 ] == '?' ) {
+        close = findString(p + 2, end, "?>", 2);
+        return close ? close + 2 : NULL;
+    }
+    return NULL;
+}
@@ -0,0 +1,136 @@
+
+#ifndef NZB_SCAN_H
+#define NZB_SCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* white space as far as XML markup is concerned */
+static inline bool isXmlSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * find the first occurrence of needle in [haystack, end).
+ *
+ * Like memmem(), but tuned for the short, fixed markup strings we look for
+ * in an NZB ("</segments>", "<file ", ...): sixteen candidate positions are
+ * checked at once by comparing both the first and the last byte of needle,
+ * and only positions where both match are verified with memcmp().
+ * @return NULL if not found, otherwise a pointer to the start of the match.
+ */
+const unsigned char * findString(const unsigned char * haystack, const unsigned char * end,
+                                 const char * needle, size_t needleLen);
+
+/**
+ * find the last occurrence of needle in [haystack, end), scanning backwards
+ * from end, so the cost is proportional to the distance of the match from
+ * the end rather than to the length of the haystack. Same approach as
+ * findString().
+ * @return NULL if not found, otherwise a pointer to the start of the match.
+ */
+const unsigned char * findLastString(const unsigned char * haystack, const unsigned char * end,
+                                     const char * needle, size_t needleLen);
+
+/**
+ * find the first '<' in [haystack, end) that is immediately followed by one
+ * of the (up to four) characters in next, e.g. "f!?" to find '<file', '<!--'
+ * and '<?' in a single pass. Same approach as findString().
+ * @return NULL if not found, otherwise a pointer to the '<'.
+ */
+const unsigned char * findMarkup(const unsigned char * haystack, const unsigned char * end,
+                                 const char * next);
+
+/**
+ * find the first tag (a string starting with '<', like "</segments") in
+ * [haystack, end), or the first '<!' or '<?', whichever comes first: so a
+ * tag can be looked for without being fooled by one inside a comment, CDATA
+ * section or processing instruction. Same approach as findString().
+ * @return NULL if neither was found, otherwise a pointer to the '<'.
+ */
+const unsigned char * findTagOrMarkup(const unsigned char * haystack, const unsigned char * end,
+                                      const char * tag, size_t tagLen);
+
+/**
+ * skip over the comment, CDATA section, processing instruction or DOCTYPE
+ * that starts at p, without parsing it.
+ * @return a pointer past its end, or NULL if it's something else, or we
+ *         can't tell where it ends (including a DOCTYPE with an internal subset)
+ */
+const unsigned char * skipMarkup(const unsigned char * p, const unsigned char * end);
+
+/** @return the next eight bytes at p, the first in the lowest byte, with zeros past end */
+static inline uint64_t loadEight(const unsigned char * p, const unsigned char * end) {
+    uint64_t chunk = 0;
+    if ( end - p >= 8 ) {
+        memcpy(&chunk, p, 8);
+    } else {
+        /* near the end, a byte at a time: memcpy() of an unknown length is a call */
+        for ( unsigned int i = 0; p + i < end; i++ ) {
+            chunk |= (uint64_t) p[ i ] << (8 * i);
+        }
+        return chunk;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    chunk = __builtin_bswap64(chunk);
+#endif
+    return chunk;
+}
+
+/**
+ * parse the run of decimal digits at p, stopping at end or the first
+ * character that isn't one.
+ *
+ * Eight digits are checked and converted per step, as bytes of a 64-bit
+ * word: no isdigit(), no branch per digit, and three multiplies in place
+ * of eight. Within eight bytes of end it has to go a byte at a time, so
+ * pass the end of the buffer rather than of the number, where there's more
+ * after it, and check where it stopped. A value too big for 64 bits isn't
+ * wrapped around: it's UINT64_MAX, like strtoull(), so a caller wanting
+ * something narrower only has to compare it.
+ * @return the number of digits, with their value in value (0 if none)
+ */
+static inline size_t parseDecimal(const unsigned char * p, const unsigned char * end, uint64_t * value) {
+    static const uint64_t scale[ 9 ] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    const unsigned char * start = p;
+    uint64_t result = 0;
+    bool overflow = false;
+
+    /* not a number at all is common enough to be worth not loading anything for */
+    if ( p == end || (unsigned int) (*p - '0') > 9 ) {
+        *value = 0;
+        return 0;
+    }
+    while ( p < end ) {
+        /* a digit is now 0-9: anything else has a bit in its top half, either
+         * now or once 6 is added. Carries only go up, past the first of them */
+        uint64_t chunk = loadEight(p, end) ^ 0x3030303030303030ULL;
+        uint64_t others = (chunk | (chunk + 0x0606060606060606ULL)) & 0xF0F0F0F0F0F0F0F0ULL;
+        unsigned int digits = others == 0 ? 8 : __builtin_ctzll(others) / 8;
+        if ( digits == 0 ) {
+            break;
+        }
+
+        /* drop what follows the digits, leaving leading zeros in its place,
+         * then combine them in pairs, fours and eights */
+        chunk <<= 8 * (8 - digits);
+        chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+        chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+        chunk = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+
+        if ( __builtin_mul_overflow(result, scale[ digits ], &result)
+             || __builtin_add_overflow(result, chunk, &result)) {
+            overflow = true;
+        }
+        p += digits;
+        if ( digits < 8 ) {
+            break;
+        }
+    }
+    *value = overflow ? UINT64_MAX : result;
+    return (size_t) (p - start);
+}
+
+#endif
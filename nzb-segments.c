@@ -0,0 +1,162 @@
+
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "nzb-segments.h"
+#include "nzb-scan.h"
+
+/* a segment, as it's parsed */
+typedef struct {
+    uint32_t     number;
+    uint32_t     bytes;
+    const byte * messageId;
+    size_t       messageIdLength;
+} tSegmentRecord;
+
+static inline const byte * skipSpace(const byte * p, const byte * end) {
+    while ( p < end && isXmlSpace(*p) ) p++;
+    return p;
+}
+
+static inline bool isNameStart(byte c) {
+    return isalpha(c) || c == '_' || c == ':';
+}
+
+static inline bool isNameChar(byte c) {
+    return isalnum(c) || c == '_' || c == ':' || c == '.' || c == '-';
+}
+
+/**
+ * @param limit how far the document goes: the value is at p, up to end
+ * @return true if the value is all digits, with a value that fits in value
+ */
+static bool parseDigits(const byte * p, const byte * end, const byte * limit, uint32_t * value) {
+    uint64_t result;
+    if ( p == end || parseDecimal(p, limit, &result) != (size_t) (end - p) || result > UINT32_MAX ) {
+        return false;
+    }
+    *value = (uint32_t) result;
+    return true;
+}
+
+/**
+ * parse the attributes of a <segment>, from just after its name.
+ * @return just after the '>' of the start tag, or NULL if it isn't one we know
+ */
+static const byte * scanAttributes(const byte * p, const byte * end, tSegmentRecord * segment) {
+    bool haveNumber = false;
+    bool haveBytes = false;
+
+    for (;;) {
+        const byte * space = p;
+        p = skipSpace(p, end);
+        if ( p >= end ) {
+            return NULL;
+        }
+        if ( *p == '>' ) {
+            return p + 1;
+        }
+        /* an attribute, which must be set apart from what came before */
+        if ( p == space || !isNameStart(*p) ) {
+            return NULL;
+        }
+        const byte * name = p;
+        while ( p < end && isNameChar(*p) ) p++;
+        size_t nameLength = p - name;
+
+        p = skipSpace(p, end);
+        if ( p >= end || *p != '=' ) {
+            return NULL;
+        }
+        p = skipSpace(p + 1, end);
+        if ( p >= end || (*p != '"' && *p != '\'') ) {
+            return NULL;
+        }
+        byte quote = *p++;
+        const byte * value = p;
+        while ( p < end && *p != quote ) {
+            if ( *p == '<' || *p == '&' || *p < ' ' || *p >= 0x80 ) {
+                return NULL;
+            }
+            p++;
+        }
+        if ( p >= end ) {
+            return NULL;
+        }
+        const byte * valueEnd = p++;
+
+        /* yxml's path uses the first of a repeated attribute: leave it to that */
+        if ( nameLength == 5 && memcmp(name, "bytes", 5) == 0 ) {
+            if ( haveBytes || !parseDigits(value, valueEnd, end, &segment->bytes)) {
+                return NULL;
+            }
+            haveBytes = true;
+        } else if ( nameLength == 6 && memcmp(name, "number", 6) == 0 ) {
+            if ( haveNumber || !parseDigits(value, valueEnd, end, &segment->number)) {
+                return NULL;
+            }
+            haveNumber = true;
+        }
+    }
+}
+
+/**
+ * parse one whole <segment> element, starting at its '<'.
+ * @return just after its end tag, or NULL if it isn't one we know
+ */
+static const byte * scanSegment(const byte * p, const byte * end, tSegmentRecord * segment) {
+    if ( end - p < 9 || memcmp(p, "<segment", 8) != 0 || (!isXmlSpace(p[ 8 ]) && p[ 8 ] != '>') ) {
+        return NULL;
+    }
+    segment->number = 0;
+    segment->bytes = 0;
+    if ((p = scanAttributes(p + 8, end, segment)) == NULL) {
+        return NULL;
+    }
+
+    /* the message-id: what yxml would collect as the contents, less trailing white space */
+    const byte * id = p;
+    while ( p < end && *p != '<' ) {
+        if ( *p == '&' || *p == ']' || *p == '\r' || *p >= 0x80 || (*p < ' ' && !isXmlSpace(*p)) ) {
+            return NULL;
+        }
+        p++;
+    }
+    const byte * idEnd = p;
+    while ( idEnd > id && !isgraph(idEnd[ -1 ]) ) idEnd--;
+    segment->messageId = id;
+    segment->messageIdLength = idEnd - id;
+
+    if ( end - p < 10 || memcmp(p, "</segment", 9) != 0 ) {
+        return NULL;
+    }
+    p = skipSpace(p + 9, end);
+    if ( p >= end || *p != '>' ) {
+        return NULL;
+    }
+    return p + 1;
+}
+
+const byte * scanSegments(const byte * p, const byte * end, tNzbIndex * index,
+                          unsigned int * segments, uint64_t * bytes) {
+    for (;;) {
+        const byte * next = skipSpace(p, end);
+        if ( end - next >= 10 && memcmp(next, "</segments", 10) == 0 ) {
+            return next;
+        }
+
+        tSegmentRecord segment;
+        if ((next = scanSegment(next, end, &segment)) == NULL) {
+            return p;
+        }
+        if ( index != NULL
+             && !addIndexSegment(index, segment.number, segment.bytes,
+                                 (const char *) segment.messageId, segment.messageIdLength)) {
+            return p;
+        }
+        (*segments)++;
+        *bytes += segment.bytes;
+        p = next;
+    }
+}
@@ -0,0 +1,31 @@
+
+#ifndef NZB_SEGMENTS_H
+#define NZB_SEGMENTS_H
+
+#include <stdint.h>
+
+#include "nzb-subject.h"
+#include "nzb-index.h"
+
+/**
+ * The fast path for the bulk of an NZB: the <segment>s of a file, parsed
+ * straight from the document into records, without yxml, elements or
+ * attributes. Segments are all alike, so this only knows the one shape:
+ *
+ *   <segment bytes="739920" number="1">message-id@host</segment>
+ *
+ * with its attributes in any order (any others are ignored), and white
+ * space between them. It stops at anything else - a comment, an entity, a
+ * byte that isn't plain ASCII, a segment cut off by the end of the piece -
+ * and leaves it to yxml. Only whole segments are skipped, so yxml can
+ * always carry on from where this stopped.
+ *
+ * @param p inside <segments>, where yxml has just parsed a '>'
+ * @param index if not NULL, gets a record for each segment
+ * @param segments incremented for each segment, and bytes by its size
+ * @return where it stopped: at the </segments end tag, if it got that far
+ */
+const byte * scanSegments(const byte * p, const byte * end, tNzbIndex * index,
+                          unsigned int * segments, uint64_t * bytes);
+
+#endif
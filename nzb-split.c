@@ -0,0 +1,190 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include "yxml.h"
+#include "nzb-split.h"
+#include "nzb-scan.h"
+#include "nzb-pool.h"
+
+/* roughly how much of the document each piece gets. Big enough that the
+ * per-piece overhead (a parser, a memory stream, a task) disappears */
+#define kSplitPieceSize  (256 * 1024)
+
+/* longest root element name we'll reopen in each piece */
+#define kSplitMaxName    64
+
+typedef struct {
+    size_t  start;          // [start, end) of the document
+    size_t  end;
+    int     result;         // from finishParser()
+    char  * output;
+    size_t  outputLength;
+} tPiece;
+
+typedef struct {
+    const tDocument * document;
+    const byte      * data;
+    tPiece          * pieces;
+    size_t            count;
+    char              open[ kSplitMaxName + 3 ];    // "<root>"
+    char              close[ kSplitMaxName + 4 ];   // "</root>"
+    size_t            openLength;
+    size_t            closeLength;
+} tSplit;
+
+/**
+ * find the root element, skipping the prolog, and make the tags that
+ * reopen and close it around each piece.
+ * @return a pointer past the root's start tag, or NULL if we can't tell
+ */
+static const byte * findRoot(tSplit * split, const byte * p, const byte * end) {
+    for (;;) {
+        p = memchr(p, '<', end - p);
+        if ( p == NULL || end - p < 2 ) {
+            return NULL;
+        }
+        if ( p[ 1 ] != '!' && p[ 1 ] != '?' ) {
+            break;
+        }
+        if ((p = skipMarkup(p, end)) == NULL) {
+            return NULL;
+        }
+    }
+
+    const byte * name = ++p;
+    while ( p < end && !isXmlSpace(*p) && *p != '>' && *p != '/' ) p++;
+    size_t length = p - name;
+    if ( length == 0 || length > kSplitMaxName ) {
+        return NULL;
+    }
+    split->openLength = sprintf(split->open, "<%.*s>", (int) length, (const char *) name);
+    split->closeLength = sprintf(split->close, "</%.*s>", (int) length, (const char *) name);
+
+    /* the end of the start tag: a '>' in a quoted attribute value isn't it */
+    while ( p < end && *p != '>' ) {
+        if ( *p == '"' || *p == '\'' ) {
+            p = memchr(p + 1, *p, end - p - 1);
+            if ( p == NULL) {
+                return NULL;
+            }
+        }
+        p++;
+    }
+    if ( p >= end || p[ -1 ] == '/' ) {
+        return NULL;
+    }
+    return p + 1;
+}
+
+/**
+ * decide where each piece starts, always right at a <file start tag.
+ * Markup that could hide a '<file' is skipped like the parser would.
+ * @return the number of pieces, 0 or 1 if the document shouldn't be split
+ */
+static size_t cutPieces(tSplit * split, const byte * p, const byte * end, size_t length) {
+    size_t wanted = length / kSplitPieceSize;
+    if ( wanted < 2 ) {
+        return 0;
+    }
+    split->pieces = calloc(wanted, sizeof(tPiece));
+    if ( split->pieces == NULL) {
+        return 0;
+    }
+
+    const byte * data = split->data;
+    size_t count = 1;
+    while ( count < wanted && (p = findMarkup(p, end, "f!?")) != NULL) {
+        if ( p[ 1 ] != 'f' ) {
+            if ((p = skipMarkup(p, end)) == NULL) {
+                return 0;
+            }
+            continue;
+        }
+        if ( end - p > 5 && memcmp(p, "<file", 5) == 0
+             && (isXmlSpace(p[ 5 ]) || p[ 5 ] == '>' || p[ 5 ] == '/')) {
+            size_t offset = p - data;
+            if ( offset >= length / wanted * count ) {
+                split->pieces[ count - 1 ].end = offset;
+                split->pieces[ count ].start = offset;
+                count++;
+            }
+        }
+        p += 2;
+    }
+    split->pieces[ count - 1 ].end = length;
+    return count;
+}
+
+/**
+ * pool task: parse one piece as a document of its own, into a memory buffer.
+ */
+static void parsePiece(void * context, size_t index, unsigned int worker) {
+    tSplit * split = context;
+    tPiece * piece = &split->pieces[ index ];
+    (void) worker;
+
+    /* nothing to write, if the document isn't written anywhere */
+    FILE * out = NULL;
+    if ( split->document->out != NULL && (out = open_memstream(&piece->output, &piece->outputLength)) == NULL) {
+        piece->result = -ENOMEM;
+        return;
+    }
+    /* the statistics would be per piece, and make no sense */
+    tDocument document = { .flags = split->document->flags & ~kParse_Statistics, .out = out, .threads = 1 };
+    tParser * parser = createParser(&document);
+    if ( parser == NULL) {
+        piece->result = -ENOMEM;
+    } else {
+        if ( index > 0 ) {
+            feedParser(parser, (const byte *) split->open, split->openLength);
+        }
+        feedParser(parser, split->data + piece->start, piece->end - piece->start);
+        if ( index < split->count - 1 ) {
+            feedParser(parser, (const byte *) split->close, split->closeLength);
+        }
+        piece->result = finishParser(parser);
+    }
+    releaseDocument(&document);
+    if ( out != NULL) {
+        fclose(out);
+    }
+}
+
+int splitFile(tDocument * document, const byte * data, size_t length) {
+    tSplit split = { .document = document, .data = data };
+    const byte * end = data + length;
+    const byte * body = findRoot(&split, data, end);
+
+    if ( body != NULL) {
+        split.count = cutPieces(&split, body, end, length);
+    }
+    if ( split.count < 2 ) {
+        free(split.pieces);
+        return processFile(document, data, length);
+    }
+
+    bool failed = runPool(document->threads, split.count, parsePiece, &split) != 0;
+    for ( size_t i = 0; i < split.count && !failed; i++ ) {
+        failed = split.pieces[ i ].result != 0;
+    }
+
+    if ( !failed ) {
+        for ( size_t i = 0; i < split.count && document->out != NULL; i++ ) {
+            fwrite(split.pieces[ i ].output, 1, split.pieces[ i ].outputLength, document->out);
+        }
+        if ( document->flags & kParse_Statistics ) {
+            fprintf(stderr, "split: %zu pieces\n", split.count);
+        }
+    }
+    for ( size_t i = 0; i < split.count; i++ ) {
+        free(split.pieces[ i ].output);
+    }
+    free(split.pieces);
+
+    /* let the serial parse find (and report) whatever went wrong */
+    return failed ? processFile(document, data, length) : 0;
+}
@@ -0,0 +1,21 @@
+
+#ifndef NZB_SPLIT_H
+#define NZB_SPLIT_H
+
+#include <stddef.h>
+
+#include "nzb-subject.h"
+
+/**
+ * parse a large NZB on several threads, by cutting it into runs of whole
+ * <file> elements and parsing each run as a document of its own. The
+ * results are written to document->out in document order.
+ *
+ * Documents that are small, have few files, or can't be cut safely are
+ * handed to processFile() as they are, as is any document a piece of which
+ * fails to parse, so errors are reported exactly as without splitting.
+ * @return same as processFile()
+ */
+int splitFile(tDocument * document, const byte * data, size_t length);
+
+#endif
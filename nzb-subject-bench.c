@@ -0,0 +1,240 @@
+
+/*
+ * Runs the whole pipeline - processInput(), so processFile() and
+ * processSubject() for every subject - over a corpus held in memory, a
+ * number of times, and reports throughput and per-NZB latency. The
+ * results also go to bench_output.txt, one 'key=value' per line, for
+ * comparing one build against another.
+ *
+ *   nzb-subject-bench [-befpst] [-J threads] [-n rounds] [-o output] [samples/ | file.nzb ...]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "nzb-subject.h"
+#include "nzb-bench.h"
+
+#define kDefaultRounds  10
+#define kDefaultOutput  "bench_output.txt"
+#define kDefaultCorpus  "samples"
+
+static const char * myName;
+
+static void outOfMemory(void) {
+    fprintf(stderr, "### %s: error: out of memory\n", myName);
+    exit(-ENOMEM);
+}
+
+static int compareNanoseconds(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/** @return the pth percentile of the sorted samples */
+static uint64_t percentile(const uint64_t * sorted, size_t count, double p) {
+    size_t i = (size_t) (p / 100.0 * (double) (count - 1) + 0.5);
+    return sorted[ i < count ? i : count - 1 ];
+}
+
+static void loadOrExit(tCorpus * corpus, const char * path) {
+    int error = loadCorpus(corpus, path);
+    if ( error != 0 ) {
+        fprintf(stderr, "### %s: error: unable to load \'%s\' (%d: %s)\n",
+                myName, path, error, strerror(error));
+        exit(-error);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: %s [-befpst] [-J threads] [-n rounds] [-o output] [directory | file.nzb ...]\n"
+            "  -b -e -f -p -s -t -J  as for nzb-subject\n"
+            "  -n  how many times to process the corpus (default %d)\n"
+            "  -o  where to write the results (default %s)\n"
+            "the corpus defaults to the files in %s/\n",
+            myName, kDefaultRounds, kDefaultOutput, kDefaultCorpus);
+}
+
+int main(int argc, char * const argv[]) {
+    myName = strrchr(argv[ 0 ], '/');
+    if ( myName++ == NULL) {
+        myName = argv[ 0 ];
+    }
+
+    tParseFlags flags = kParse_Default;
+    int splitThreads = 1;
+    int rounds = kDefaultRounds;
+    const char * outputPath = kDefaultOutput;
+    int opt;
+    while ((opt = getopt(argc, argv, "befJ:n:o:pst")) != -1) {
+        switch ( opt ) {
+        case 'b':
+            flags |= kParse_ByteWise;
+            break;
+
+        case 'e':
+            flags |= kParse_EarlyExit;
+            break;
+
+        case 'f':
+            flags |= kParse_Families;
+            break;
+
+        case 'p':
+            flags |= kParse_Prefilter;
+            break;
+
+        case 's':
+            flags |= kParse_SubjectsOnly;
+            break;
+
+        case 't':
+            flags |= kParse_Templates;
+            break;
+
+        case 'J':
+            splitThreads = atoi(optarg);
+            if ( splitThreads < 0 ) {
+                usage();
+                exit(EINVAL);
+            }
+            if ( splitThreads != 1 ) {
+                flags |= kParse_Split;
+            }
+            break;
+
+        case 'n':
+            rounds = atoi(optarg);
+            if ( rounds < 1 ) {
+                usage();
+                exit(EINVAL);
+            }
+            break;
+
+        case 'o':
+            outputPath = optarg;
+            break;
+
+        default:
+            usage();
+            exit(EINVAL);
+        }
+    }
+
+    tCorpus corpus = { NULL, 0, 0 };
+    if ( optind >= argc ) {
+        loadOrExit(&corpus, kDefaultCorpus);
+    }
+    for ( int i = optind; i < argc; i++ ) {
+        loadOrExit(&corpus, argv[ i ]);
+    }
+    if ( corpus.count == 0 ) {
+        fprintf(stderr, "### %s: error: no files to process\n", myName);
+        exit(EINVAL);
+    }
+
+    FILE * devNull = fopen("/dev/null", "w");
+    if ( devNull == NULL) {
+        fprintf(stderr, "### %s: error: unable to open /dev/null (%d: %s)\n", myName, errno, strerror(errno));
+        exit(-errno);
+    }
+
+    size_t bytes = 0;
+    size_t subjects = 0;
+    for ( size_t i = 0; i < corpus.count; i++ ) {
+        tCorpusFile * file = &corpus.files[ i ];
+        int result = captureSubjects(file, flags, (unsigned int) splitThreads, NULL);
+        if ( result < 0 ) {
+            fprintf(stderr, "### %s: error: unable to process \'%s\' (%d)\n", myName, file->path, result);
+            exit(result);
+        }
+        file->nanoseconds = calloc(rounds, sizeof(uint64_t));
+        if ( file->nanoseconds == NULL) {
+            outOfMemory();
+        }
+        bytes += file->length;
+        subjects += file->subjects;
+    }
+
+    uint64_t total = 0;
+    for ( int r = 0; r < rounds; r++ ) {
+        for ( size_t i = 0; i < corpus.count; i++ ) {
+            tCorpusFile * file = &corpus.files[ i ];
+            tDocument document = { .flags = flags, .out = devNull, .threads = (unsigned int) splitThreads };
+
+            uint64_t start = benchNanoseconds();
+            processInput(&document, file->data, file->length);
+            fflush(devNull);
+            uint64_t elapsed = benchNanoseconds() - start;
+
+            releaseDocument(&document);
+            file->nanoseconds[ r ] = elapsed;
+            total += elapsed;
+        }
+    }
+    fclose(devNull);
+
+    /* every run of every file, for the percentiles */
+    size_t runs = corpus.count * (size_t) rounds;
+    uint64_t * latencies = malloc(runs * sizeof(uint64_t));
+    if ( latencies == NULL) {
+        outOfMemory();
+    }
+    for ( size_t i = 0; i < corpus.count; i++ ) {
+        memcpy(&latencies[ i * rounds ], corpus.files[ i ].nanoseconds, rounds * sizeof(uint64_t));
+        qsort(corpus.files[ i ].nanoseconds, rounds, sizeof(uint64_t), compareNanoseconds);
+    }
+    qsort(latencies, runs, sizeof(uint64_t), compareNanoseconds);
+
+    double seconds = (double) total / 1e9;
+    double megabytesPerSecond = (double) bytes * rounds / (1024.0 * 1024.0) / seconds;
+    double filesPerSecond = (double) runs / seconds;
+    double subjectsPerSecond = (double) subjects * rounds / seconds;
+    uint64_t p50 = percentile(latencies, runs, 50);
+    uint64_t p90 = percentile(latencies, runs, 90);
+    uint64_t p99 = percentile(latencies, runs, 99);
+    uint64_t max = latencies[ runs - 1 ];
+
+    printf("%zu files, %zu bytes, %zu subjects, %d rounds in %.3f s\n",
+           corpus.count, bytes, subjects, rounds, seconds);
+    printf("%10.1f MB/s\n%10.1f files/s\n%10.1f subjects/s\n", megabytesPerSecond, filesPerSecond, subjectsPerSecond);
+    printf("latency per NZB: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+           p50 / 1e3, p90 / 1e3, p99 / 1e3, max / 1e3);
+
+    FILE * results = fopen(outputPath, "w");
+    if ( results == NULL) {
+        fprintf(stderr, "### %s: error: unable to write \'%s\' (%d: %s)\n",
+                myName, outputPath, errno, strerror(errno));
+        exit(-errno);
+    }
+    fprintf(results, "flags=0x%x\n", flags);
+    fprintf(results, "split_threads=%d\n", splitThreads);
+    fprintf(results, "rounds=%d\n", rounds);
+    fprintf(results, "files=%zu\n", corpus.count);
+    fprintf(results, "bytes=%zu\n", bytes);
+    fprintf(results, "subjects=%zu\n", subjects);
+    fprintf(results, "seconds=%.6f\n", seconds);
+    fprintf(results, "mb_per_second=%.3f\n", megabytesPerSecond);
+    fprintf(results, "files_per_second=%.3f\n", filesPerSecond);
+    fprintf(results, "subjects_per_second=%.3f\n", subjectsPerSecond);
+    fprintf(results, "latency_p50_us=%.3f\n", p50 / 1e3);
+    fprintf(results, "latency_p90_us=%.3f\n", p90 / 1e3);
+    fprintf(results, "latency_p99_us=%.3f\n", p99 / 1e3);
+    fprintf(results, "latency_max_us=%.3f\n", max / 1e3);
+    for ( size_t i = 0; i < corpus.count; i++ ) {
+        const tCorpusFile * file = &corpus.files[ i ];
+        fprintf(results, "file=%s\tbytes=%zu\tsubjects=%zu\tp50_us=%.3f\n",
+                file->path, file->length, file->subjects, percentile(file->nanoseconds, rounds, 50) / 1e3);
+    }
+    fclose(results);
+
+    releaseCorpus(&corpus);
+    free(latencies);
+    return 0;
+}
@@ -4,9 +4,23 @@
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "yxml.h"
+#include "nzb-subject.h"
+#include "nzb-prefilter.h"
+#include "nzb-split.h"
+#include "nzb-scan.h"
+#include "nzb-arena.h"
+#include "nzb-keywords.h"
+#include "nzb-classify.h"
+#include "nzb-template.h"
+#include "nzb-family.h"
+#include "nzb-api.h"
+#include "nzb-index.h"
+#include "nzb-segments.h"
 
 // #define DEBUG_VERBOSE 1
 //#undef DEBUG
@@ -17,9 +31,7 @@
 #define logDebug( ... )    do {} while (0)
 #endif
 
-typedef unsigned char byte;
-
-static struct {
+static const struct {
     enum eRunEndType { kNotEnd = 0, kSeparator, kDoubleQuotes, kLeftSquareBracket, kRightSquareBracket } runEndType;
 } charMap[256] = {
         ['\0'] = { kSeparator },
@@ -30,7 +42,8 @@ static struct {
         [']']  = { kRightSquareBracket }
 };
 
-const char * runEndTypeAsString[] = {
+#if DEBUG
+static const char * const runEndTypeAsString[] = {
     [kNotEnd]             = "not end",
     [kSeparator]          = "seperator",
     [kDoubleQuotes]       = "quoted",
@@ -39,20 +52,7 @@ const char * runEndTypeAsString[] = {
 };
 
 
-typedef enum {
-    kSep_nop = 0,             // ''
-    kSep_startSq,             // '[', '[ ', ' [', ' [ '
-    kSep_endSq,               // ']', '] ', ']  '
-    kSep_dash,                // ' -', ' - ', ' -  ', '--'
-    kSep_endBracket,          // ')', ') '
-    kSep_startBracket,        // '(', ' (', '  ('
-    kSep_emptyQuotes,         // '""'
-    kSep_startQuotes,         // ' "',
-    kSep_endQuotes,           // '" ', '"  '
-    kSep_space                // ' ', '  '
-} tSeparatorIndex;
-
-const char * sepTokenToString[] = {
+static const char * const sepTokenToString[] = {
         [kSep_nop]                = "-",
         [kSep_startSq]            = "(start square)",
         [kSep_endSq]              = "(end square)",
@@ -64,106 +64,7 @@ const char * sepTokenToString[] = {
         [kSep_endQuotes]          = "(end quotes)",
         [kSep_space]              = "(space)"
 };
-
-struct {
-    unsigned long hash;
-    tSeparatorIndex index[2];
-} separatorHashTable[] = {
-        { 0x00000000deadbeef, {}},                                           // ''
-//        { 0x000000283f4bb0d1, { kSep_endSq, kSep_nop } },                            // ']'
-//        { 0x000000283f4bb0d3, { kSep_startSq, kSep_nop } },                          // '['
-//        { 0x000000283f4bb0e1, { kSep_dash.0 } },                             // '-'
-//        { 0x000000283f4bb0e5, { kSep_endBracket} },                        // ')'
-//        { 0x000000283f4bb0e6, { kSep_startBracket} },                      // '('
-        { 0x000000283f4bb0ec, { kSep_endQuotes,  kSep_startQuotes }},                      // '"'
-        { 0x000000283f4bb0ee, { kSep_space }},                            // ' '
-        { 0x0000074ba1aec60e, { kSep_startSq }},                          // '[ '
-        { 0x0000074ba1aec65d, { kSep_endSq }},                            // ']-'
-        { 0x0000074ba1aec66b, { kSep_endSq,      kSep_startSq }},           // ']['
-        { 0x0000074ba1aec6ae, { kSep_endSq }},                            // '] '
-        { 0x0000074ba1aec94b, { kSep_startSq }},                          // '-['
-        { 0x0000074ba1aec99d, { kSep_dash }},                             // '--'
-        { 0x0000074ba1aecace, { kSep_endBracket }},                       // ') '
-        { 0x0000074ba1aecadd, { kSep_endBracket }},                       // ')-'
-        { 0x0000074ba1aecb31, { kSep_dash }},                             // ' -'
-        { 0x0000074ba1aecb34, { kSep_startBracket }},                     // ' ('
-        { 0x0000074ba1aecb3a, { kSep_startQuotes }},                      // ' "'
-        { 0x0000074ba1aecb3c, { kSep_space }},                            // '  '
-        { 0x0000074ba1aecb98, { kSep_endQuotes }},                        // '" '
-//      { 0x0000074ba1aecc18, { } },                                           // ': '
-        { 0x0000074ba1aecce3, { kSep_startSq }},                          // ' ['
-//      { 0x0000074ba1aecdf2, { } },                                           // '::'
-        { 0x000151a90eb8ad33, { kSep_endSq,      kSep_startSq }},                // ']-['
-        { 0x000151a90eb8ad68, { kSep_endSq,      kSep_startQuotes }},       // ']-"'
-        { 0x000151a90eb8bcba, { kSep_endSq,      kSep_startQuotes }},       // '] "'
-        { 0x000151a90eb8bcbc, { kSep_endSq }},                            // ']  '
-        { 0x000151a90eb8bce3, { kSep_endSq,      kSep_startSq }},          // '] ['
-        { 0x000151a90eb9023b, { kSep_startSq }},                          // '::['
-        { 0x000151a90eb90264, { kSep_startBracket }},                     // '::('
-        { 0x000151a90eb9512e, { kSep_startSq }},                          // ' [ '
-//        { 0x000151a90eb9852e, { kSep_dash } },                             // ' - '
-        { 0x000151a90eb9856b, { kSep_startSq }},                          // ' -['
-        { 0x000151a90eb99b10, { kSep_startBracket }},                     // '  ('
-        { 0x000151a90eb9aa88, { kSep_endQuotes,  kSep_startBracket }},  // '" ('
-        { 0x000151a90eb9aa90, { kSep_endQuotes }},                        // '"  '
-        { 0x000151a90eb9aadb, { kSep_endQuotes,  kSep_startSq }},          // '" ['
-//        { 0x000151a90eb9b492, { kSep_colon, kSep_startQuotes } },          // ': "'
-        { 0x000151a90eb9c8e3, { kSep_dash,       kSep_startSq }},                          // '- ['
-        { 0x000151a90eb9f134, { kSep_endBracket, kSep_startBracket }},    // ') ('
-        { 0x000151a90eb9f13a, { kSep_endBracket }},                       // ') "'
-        { 0x000151a90eb9f6e3, { kSep_endBracket, kSep_startSq }},         // ') ['
-        { 0x003cafa0baa5e0e3, { kSep_dash,       kSep_startSq }},                          // '-- ['
-        { 0x003cafa0baaffa8e, { kSep_endQuotes }},                        // '" - '
-        { 0x003cafa0bab6f6ba, { kSep_startQuotes }},                      // ' - "'
-        { 0x003cafa0bab6f6bc, { kSep_dash }},                             // ' -  '
-        { 0x003cafa0bab6f6e3, { kSep_dash,       kSep_startSq }},            // ' - ['
-        { 0x003cafa0babca8e3, { kSep_endSq,      kSep_startSq }},              // ' ] ['
-        { 0x003cafa0babcadb3, { kSep_endSq,      kSep_startSq }},                // ' ]-['
-        { 0x003cafa0bd4e6ace, { kSep_startSq }},                          // '::[ '
-        { 0x003cafa0bd52182e, { kSep_endSq }},                            // '] - '
-        { 0x003cafa0bd521a3b, { kSep_endSq,      kSep_startQuotes }},          // '] "['
-        { 0x003cafa0bd521ae9, { kSep_endSq,      kSep_startQuotes }},          // '] "-'
-//        { 0x003cafa0bd5e4133, { } },                              // ']]-['
-        { 0x003cafa0bd5f614e, { kSep_endSq,      kSep_startSq }},                // ']-[ '
-        { 0x003cafa0bd630eb4, { kSep_startBracket }},                     // '[[ ('
-        { 0x029a3448818ee8ba, { kSep_endSq,      kSep_startQuotes }},          // ' ] - "'
-        { 0x029a3448818ee8e3, { kSep_endSq,      kSep_startSq }},                // ' ] - ['
-//        { 0x029a344e2ef57a0d, { } },                              // '--:-:-'
-//        { 0x029a3476db94a29d, { } },                              // '-:-:--'
-        { 0x029a34772393523b, { kSep_endSq,      kSep_startQuotes }},          // '] - "['
-        { 0x029a347723a67aba, { kSep_endSq,      kSep_startQuotes }},          // ']  - "'
-        { 0x0b1891227f4068ba, { kSep_endSq,      kSep_startQuotes }},          // '] - "'
-        { 0x0b1891227f4068e3, { kSep_endSq,      kSep_startSq }},                // '] - ['
-        { 0x0b1891227f40ea1d, { kSep_endSq,      kSep_startQuotes }},          // '] "--'
-        { 0x0b189122f21f4e4e, { kSep_endSq,      kSep_startSq }},                // ' ]-[ '
-        { 0x0b189122fce0fab4, { kSep_endQuotes,  kSep_startBracket }},     // '" - ('
-        { 0x0b189122fce0faba, { kSep_endQuotes,  kSep_startQuotes }},      // '" - "'
-        { 0x0b189122fd21ba1a, { kSep_startQuotes }},                      // ' -  "'
-
-        { 0x78d595a8ab9f687c, { kSep_endSq,      kSep_emptyQuotes }},          // '] - "" '
-        { 0x78d5ad0748b2292e, { kSep_endSq,      kSep_startSq }},                // ' ] - [ '
-        { 0,                  {}}
-};
-
-typedef enum {
-    kToken_Unset = 0,
-    kToken_Separator, // 1
-    kToken_Unquoted,  // 2
-    kToken_Quoted,    // 3
-    kToken_Empty,     // 4
-    kToken_String,    // 5
-    kToken_Number,    // 6
-    kToken_Fraction,  // 7
-    kToken_WtFnZb,    // 8
-    kToken_PRiVATE,   // 9
-    kToken_N3wZ,      // a
-    kToken_newzNZB,   // b
-    kToken_FULL,      // c
-    kToken_yEnc,      // d
-    kToken_Of,        // e
-    kTokenTypeMax     // f
-} tTokenType;
-
+#endif
 
 static const char * tokenTypeNames[kTokenTypeMax] = {
         [kToken_Unset]     = "unset",
@@ -184,45 +85,6 @@ static const char * tokenTypeNames[kTokenTypeMax] = {
 };
 
 
-typedef enum {
-    kHash_Unset = 0,
-    kHash_Empty = 0xDeadBeef,
-    kHash_OneSpace = 0x000000283f4bb0ee, // hash after parsing a single space
-
-    // elements
-    kHash_NZB = 0x000151a90eb474b2,
-    kHash_Segments = 0x57ef75389804b12b,
-    kHash_Segment = 0x78d5ad74034dd104,
-    kHash_Head = 0x003cafa0bdb94552,
-    kHash_Meta = 0x003cafa0bd974cbd,
-    kHash_Groups = 0x029a347370b2f5eb,
-    kHash_Group = 0x0b18912267fc3ade,
-    kHash_File = 0x003cafa0bdeb36b1,
-
-    // attributes
-    kHash_Xmlns = 0x0b189122f49400cb,
-    kHash_Type = 0x003cafa0badc89f9,
-    kHash_Subject = 0x78d5adc5d7a0afe2,
-    kHash_Date = 0x003cafa0bda6aa31,
-    kHash_Bytes = 0x0b189122f1c044a3,
-    kHash_Number = 0x029a34715398d358,
-    kHash_Poster = 0x029a344bcb84b4a0,
-
-    // subject
-    kHash_WtFnZb = 0x029a3476ebecf502,
-    kHash_PRiVATE = 0x78d5ad39d3933041,
-    kHash_N3wZ = 0x003cafa0bae64024,
-    kHash_newzNZB = 0x78d594be57432922,
-    kHash_FULL = 0x003cafa0bd59fc48,
-    kHash_yEnc = 0x003cafa0bacd759b,
-    kHash_Of = 0x0000074ba1aec3c8,
-
-    // guarantee the enum width is at least 64 bits
-    kHash_ForceWidth = 0x8070605040302010
-} tHash;
-
-typedef unsigned long tSignature;
-
 typedef struct sAttribute {
     struct sAttribute * next;
 
@@ -232,6 +94,7 @@ typedef struct sAttribute {
 
 typedef struct sElement {
     struct sElement * next;
+    tArenaMark mark;            // the arena before this element was allocated
 
     tHash elementHash;
     tAttribute * attributes;
@@ -239,7 +102,7 @@ typedef struct sElement {
 } tElement;
 
 
-struct {
+static const struct {
     tHash hash;
     const char * string;
 } hashAsString[] = {
@@ -262,15 +125,6 @@ struct {
         { kHash_Number,   "Number" },
         { kHash_Poster,   "Poster" },
 
-        // subject
-        { kHash_WtFnZb,   "WtFnZb" },
-        { kHash_PRiVATE,  "PRiVATE" },
-        { kHash_N3wZ,     "N3wZ" },
-        { kHash_newzNZB,  "newzNZB" },
-        { kHash_FULL,     "FULL" },
-        { kHash_yEnc,     "yEnc" },
-        { kHash_Of,       "Of" },
-
         { kHash_Unset,    "Unset" },
         { kHash_Empty,    "Empty" },
         { 0, NULL }
@@ -289,15 +143,12 @@ tHash hashString(const unsigned char * string, const int maxLen) {
 }
 
 int parseInteger(const unsigned char * string, const int maxLen) {
-    int result = 0;
-    for ( int i = 0; i < maxLen; i++ ) {
-        if ( isdigit(string[ i ])) {
-            result = result * 10 + (string[ i ] - '0');
-        } else {
-            return -1;
-        }
+    size_t length = maxLen > 0 ? (size_t) maxLen : 0;
+    uint64_t value;
+    if ( parseDecimal(string, string + length, &value) != length || value > INT_MAX ) {
+        return -1;
     }
-    return result;
+    return (int) value;
 }
 
 const char * describeHash(tHash hash) {
@@ -428,27 +279,26 @@ void processBracketed( const unsigned char *start, const unsigned char *end )
             logDebug("all digits: %ld\n", index);
         }
     } else {
-        tHash hash = hashString( start, end - start );
-        switch (hash)
+        switch (lookupKeyword( start, end - start ))
         {
-        case kHash_FULL:
+        case kToken_FULL:
             logDebug("### FULL\n");
             break;
 
-        case kHash_N3wZ:
+        case kToken_N3wZ:
             logDebug("### N3wZ\n");
             break;
 
-        case kHash_PRiVATE:
+        case kToken_PRiVATE:
             logDebug("### PRiVATE\n");
             break;
 
-        case kHash_WtFnZb:
+        case kToken_WtFnZb:
             logDebug("### WtFNzB\n");
             break;
 
         default:
-            logDebug("### unhandled: \'%.*s\' %s\n", (int)(end - start), start, describeHash(hash));
+            logDebug("### unhandled: \'%.*s\'\n", (int)(end - start), start);
             break;
         }
     }
@@ -523,62 +373,52 @@ unsigned char * strrstr(unsigned char * haystack, const unsigned char * needle)
     return result;
 }
 
-tSignature identifyToken(tHash hash, const byte * str, size_t len) {
-    const byte * p;
-    unsigned int value;
-    unsigned int divisor;
+/**
+ * classify a token: one of the keywords in nzb-keywords.def, a number, a
+ * fraction like '12/34', or just a string.
+ */
+tSignature identifyToken(const byte * str, size_t len) {
     tSignature result;
 
-    switch ( hash ) {
-    case kHash_Empty:
-        result = kToken_Empty;
-        break;
-    case kHash_N3wZ:
-        result = kToken_N3wZ;
-        break;
-    case kHash_newzNZB:
-        result = kToken_newzNZB;
-        break;
-    case kHash_WtFnZb:
-        result = kToken_WtFnZb;
-        break;
-
-    case kHash_PRiVATE:
-        result = kToken_PRiVATE;
-        break;
-    case kHash_FULL:
-        result = kToken_FULL;
-        break;
-    case kHash_yEnc:
-        result = kToken_yEnc;
-        break;
-    case kHash_Of:
-        result = kToken_Of;
-        break;
-
-    default:
-        result = kToken_Number;
-        value = 0;
-        divisor = 0;
-        for ( int i = 0; i < len; i++ ) {
-            if ( isdigit(str[ i ])) {
-                value = value * 10 + (str[ i ] - '0');
-            } else if ( str[ i ] == '/' ) {
-                divisor = value;
-                value = 0;
-                result = kToken_Fraction;
-            } else {
-                // result = kToken_Quoted;
-                result = kToken_String;
-                break;
-            }
+    if ( len == 0 ) {
+        return kToken_Empty;
+    }
+    result = lookupKeyword(str, len);
+    if ( result != kToken_Unset ) {
+        return result;
+    }
+
+    /* runs of digits, optionally separated by slashes */
+    result = kToken_Number;
+    const byte * end = str + len;
+    for ( const byte * p = str; p < end; p++ ) {
+        uint64_t value;
+        p += parseDecimal(p, end, &value);
+        if ( p == end ) {
+            break;
         }
-        break;
+        if ( *p != '/' ) {
+            // result = kToken_Quoted;
+            result = kToken_String;
+            break;
+        }
+        result = kToken_Fraction;
     }
 
     return result;
 }
 
+/**
+ * the type of a token of the given kind: quoted ones are just quoted (or
+ * empty), anything else is whatever identifyToken() makes of it.
+ */
+tTokenType tokenType(tTokenType kind, const byte * str, size_t len) {
+    if ( kind == kToken_Quoted ) {
+        return len == 0 ? kToken_Empty : kToken_Quoted;
+    }
+    return (tTokenType) identifyToken(str, len);
+}
+
 /*
   Observed Variations of the subject field:
 
@@ -595,19 +435,17 @@ tSignature identifyToken(tHash hash, const byte * str, size_t len) {
 
 */
 
-unsigned char * preprocessSubject(const unsigned char * subject) {
-    fprintf(stdout, "\ns: %s\n", subject);
-    unsigned char * subj = (byte *) strdup(subject);
-
+size_t trimSubject(const byte * subject, size_t length) {
     /* Trim a yEnc suffix, if present.
      * Trim only at the last one - I've seen cases where another 'yEnc'
-     * keyword is embedded in the _middle_ of the subject ?!?! */
-    unsigned char * e = strrstr(subj, " yEnc");
+     * keyword is embedded in the _middle_ of the subject ?!?!
+     * It's nearly always close to the end, so search from there. */
+    const unsigned char * e = findLastString(subject, subject + length, " yEnc", 5);
     if ( e != NULL) {
         /* back up over trailing separators */
         while ( e > subject && charMap[ *e ].runEndType == kSeparator ) { --e; }
-        /* terminate the string */
-        e[ 1 ] = '\0';
+        /* the subject now ends after e */
+        length = e + 1 - subject;
     }
 
 #if 0
@@ -633,17 +471,144 @@ unsigned char * preprocessSubject(const unsigned char * subject) {
 
     fprintf( stdout, "d: %s\n", subj );
 #endif
-    return subj;
+    return length;
+}
+
+/**
+ * print the subject, and trim it to the part worth tokenizing.
+ * @return the length of the subject without any yEnc suffix
+ */
+size_t preprocessSubject(tDocument * document, const unsigned char * subject, size_t length) {
+    if ( document->out != NULL) {
+        fprintf(document->out, "\ns: %.*s\n", (int) length, subject);
+    }
+    return trimSubject(subject, length);
+}
+
+/**
+ * the charMap[] run end type of the byte at bit in the classified block.
+ */
+static inline enum eRunEndType runEndAt(const tCharMasks * masks, unsigned int bit) {
+    if ( (masks->separator >> bit) & 1 ) return kSeparator;
+    if ( (masks->quote >> bit) & 1 ) return kDoubleQuotes;
+    if ( (masks->open >> bit) & 1 ) return kLeftSquareBracket;
+    if ( (masks->close >> bit) & 1 ) return kRightSquareBracket;
+    return kNotEnd;
 }
 
-void processSubject(const unsigned char * subject)
+/**
+ * classify the block of the subject starting at block. The subject ends
+ * at end, where the tokenizer expects to see a '\0', so mark one there.
+ */
+static inline void classifySubject(const unsigned char * block, const unsigned char * end, tCharMasks * masks) {
+    size_t length = end - block;
+    classifyBlock(block, length, masks);
+    if ( length < kClassifyBlock ) {
+        masks->separator |= (uint64_t) 1 << length;
+    }
+}
+
+char * materializeSpan(const byte * subject, tSpan span) {
+    char * result = malloc(span.length + 1);
+    if ( result != NULL) {
+        memcpy(result, subject + span.offset, span.length);
+        result[ span.length ] = '\0';
+    }
+    return result;
+}
+
+/**
+ * record a token of the subject, trimmed of separators at either end.
+ */
+static void addToken(tSubjectInfo * info, const byte * subject, tTokenType kind,
+                     const byte * start, const byte * end, unsigned char terminator) {
+    while ( start < end && charMap[ *start ].runEndType == kSeparator ) start++;
+    while ( start < end && charMap[ end[ -1 ] ].runEndType == kSeparator ) end--;
+
+    if ( info->tokenCount < kMaxSubjectTokens ) {
+        tSubjectToken * token = &info->tokens[ info->tokenCount ];
+        token->kind = kind;
+        token->type = tokenType(kind, start, end - start);
+        token->span.offset = (unsigned int) (start - subject);
+        token->span.length = (unsigned int) (end - start);
+        token->terminator = terminator;
+    }
+    info->tokenCount++;
+}
+
+/* what has been picked out of the tokens so far */
+typedef struct {
+    tTokenType bracketed[2];    // the last two bracketed tokens
+    bool       filename;
+    bool       counter;
+} tResolution;
+
+/**
+ * pick what we can out of the next token: the filename is the first quoted
+ * token that isn't empty, or the field after [PRiVATE]-[WtFnZb], whichever
+ * comes first; the counter is the first n/m fraction.
+ * @return true once both are known, so nothing later can change them
+ */
+static bool resolveToken(tSubjectInfo * info, tResolution * resolution, const byte * subject, const tSubjectToken * token) {
+    if ( !resolution->filename ) {
+        if ( token->kind == kToken_Quoted && token->type == kToken_Quoted ) {
+            info->filename = token->span;
+            resolution->filename = true;
+        } else if ( token->kind == kToken_String ) {
+            if ( token->type == kToken_String
+                 && resolution->bracketed[ 0 ] == kToken_PRiVATE && resolution->bracketed[ 1 ] == kToken_WtFnZb ) {
+                info->filename = token->span;
+                resolution->filename = true;
+            }
+            resolution->bracketed[ 0 ] = resolution->bracketed[ 1 ];
+            resolution->bracketed[ 1 ] = token->type;
+        }
+    }
+
+    if ( !resolution->counter && token->type == kToken_Fraction ) {
+        const byte * fraction = subject + token->span.offset;
+        const byte * slash = memchr(fraction, '/', token->span.length);
+        int before = (int) (slash - fraction);
+        int after = (int) token->span.length - before - 1;
+        if ( before > 0 && after > 0 ) {
+            int index = parseInteger(fraction, before);
+            int total = parseInteger(slash + 1, after);
+            if ( index >= 0 && total > 0 ) {
+                info->index = (unsigned int) index;
+                info->total = (unsigned int) total;
+                resolution->counter = true;
+            }
+        }
+    }
+    return resolution->filename && resolution->counter;
+}
+
+/**
+ * pick the filename and the counter out of the tokens.
+ */
+static void resolveSubject(tSubjectInfo * info, const byte * subject) {
+    tResolution resolution = { { kToken_Unset, kToken_Unset }, false, false };
+    unsigned int count = info->tokenCount < kMaxSubjectTokens ? info->tokenCount : kMaxSubjectTokens;
+
+    info->filename.offset = 0;
+    info->filename.length = 0;
+    info->index = 0;
+    info->total = 0;
+    info->confident = false;
+    for ( unsigned int i = 0; i < count && !info->confident; i++ ) {
+        info->confident = resolveToken(info, &resolution, subject, &info->tokens[ i ]);
+    }
+}
+
+void tokenizeSubject(const byte * subject, tSubjectInfo * info, tParseFlags flags)
 {
     const unsigned char * tokenStart;
-    const unsigned char * tokenEnd;
+    const unsigned char * tokenEnd = NULL;
     unsigned int tokenLen;
              int tokenLevel = 0;
     const unsigned char * separatorStart;
-    const unsigned char * filename = NULL;
+    const unsigned char * quoteStart = NULL;      // inside a quoted token
+    const unsigned char * bracketStart = NULL;    // inside a [bracketed] token
 
     tHash hash = kHash_Empty;
 
@@ -653,22 +618,44 @@ void processSubject(const unsigned char * subject)
 #endif
 
 
-    unsigned char * subj = preprocessSubject(subject);
+    info->tokenCount = 0;
+    info->partial = false;
 
-    const unsigned char * p = subj;
+    /* for kParse_EarlyExit: how far the tokens have been resolved */
+    bool earlyExit = (flags & kParse_EarlyExit) != 0;
+    tResolution resolution = { { kToken_Unset, kToken_Unset }, false, false };
+    unsigned int resolved = 0;
+    tSubjectInfo scratch;
+
+    const unsigned char * p = subject;
     tokenStart = p;
     separatorStart = p;
 
+    /* The tokenizer works in place: the (trimmed) subject ends at end, and
+     * the position of end itself reads as a '\0'. The characters that end
+     * runs are found 64 at a time; the block's masks are refreshed whenever
+     * p moves past it. */
+    const unsigned char * end = subject + info->trimmed.length;
+    const unsigned char * block = p;
+    tCharMasks masks;
+    classifySubject(block, end, &masks);
+
     enum eRunEndType wasEndRun = kNotEnd;
 
     do {
-        enum eRunEndType endRun  = charMap[ *p ].runEndType;
+        if ( p - block >= kClassifyBlock ) {
+            block = p;
+            classifySubject(block, end, &masks);
+        }
+        unsigned int bit = (unsigned int) (p - block);
+        enum eRunEndType endRun = runEndAt(&masks, bit);
+        unsigned char c = p < end ? *p : '\0';
 
 #ifdef DEBUG
-        unsigned int i = (unsigned int) (p - subj);
+        unsigned int i = (unsigned int) (p - subject);
         if ( i >= sizeof(debug[ 0 ])) i = sizeof(debug[ 0 ]) - 1;
 
-        debug[ 0 ][ i ] = *p;
+        debug[ 0 ][ i ] = c;
         debug[ 1 ][ i ] = '0' + (endRun);
         debug[ 2 ][ i ] = (endRun != kNotEnd) ? '^' : '_';
         debug[ 3 ][ i ] = (char) ('0' + tokenLevel);
@@ -677,6 +664,10 @@ void processSubject(const unsigned char * subject)
 //        if (tokenLevel == 0) {
             if ( endRun != kNotEnd && wasEndRun == kNotEnd && (p - tokenStart) > 1 ) {
                 logDebug("%s: \'%.*s\' hash: 0x%016lx\n", runEndTypeAsString[endRun], (int) (tokenEnd - tokenStart), tokenStart, hash);
+                /* a word outside of any quotes or brackets */
+                if ( tokenLevel == 0 && tokenEnd != NULL && tokenStart < tokenEnd && tokenEnd <= p ) {
+                    addToken(info, subject, kToken_Unquoted, tokenStart, tokenEnd, c);
+                }
                 tokenStart = p;
                 hash = kHash_Empty;
             }
@@ -696,6 +687,7 @@ void processSubject(const unsigned char * subject)
             if ( tokenLevel == 0) {
                 /* start of quoted string */
                 tokenStart = p + 1;
+                quoteStart = p + 1;
                 hash = kHash_Empty;
                 ++tokenLevel;
             } else {
@@ -705,19 +697,24 @@ void processSubject(const unsigned char * subject)
                 } else {
                     logDebug("quoted: \"%.*s\"\n", (int) (tokenEnd - tokenStart), tokenStart);
                 }
+                if ( quoteStart != NULL) {
+                    addToken(info, subject, kToken_Quoted, quoteStart, p, c);
+                    quoteStart = NULL;
+                }
                 --tokenLevel;
             }
             break;
 
         case kLeftSquareBracket:
-            if ( p[ 1 ] == '[' ) {
+            if ( p + 1 < end && p[ 1 ] == '[' ) {
                 /* ignore '[[' */
                 p++;
             } else {
                 if ( tokenLevel == 0 ) {
                     tokenStart = p + 1;
                     /* skip over any leading separators */
-                    while ( charMap[ *tokenStart ].runEndType == kSeparator ) { ++tokenStart; }
+                    while ( tokenStart < end && charMap[ *tokenStart ].runEndType == kSeparator ) { ++tokenStart; }
+                    bracketStart = p + 1;
                     hash = kHash_Empty;
                 }
                 ++tokenLevel;
@@ -725,7 +722,7 @@ void processSubject(const unsigned char * subject)
             break;
 
         case kRightSquareBracket:
-            if ( p[ 1 ] == ']' ) {
+            if ( p + 1 < end && p[ 1 ] == ']' ) {
                 p++;
             } else {
                 --tokenLevel;
@@ -736,6 +733,11 @@ void processSubject(const unsigned char * subject)
                         logDebug(" hash: 0x%016lx", hash);
                     }
                     logDebug("\n");
+
+                    if ( bracketStart != NULL) {
+                        addToken(info, subject, kToken_String, bracketStart, p, c);
+                        bracketStart = NULL;
+                    }
                 }
             }
             break;
@@ -752,8 +754,22 @@ void processSubject(const unsigned char * subject)
             } else
         default:
             {
-                hash ^= (hash * 47) + *p;
+                hash ^= (hash * 47) + c;
                 tokenEnd = p + 1;
+#ifndef DEBUG
+                /* Nothing else in this run can end anything, so take the rest of it
+                 * (within this block) in one go. The debug build still goes byte by
+                 * byte, to fill in its trace. */
+                if ( endRun == kNotEnd ) {
+                    uint64_t special = (masks.separator | masks.quote | masks.open | masks.close) >> bit >> 1;
+                    unsigned int run = special != 0 ? (unsigned int) __builtin_ctzll(special) : kClassifyBlock - 1 - bit;
+                    for ( const unsigned char * q = p + 1; q <= p + run; q++ ) {
+                        hash ^= (hash * 47) + *q;
+                    }
+                    p += run;
+                    tokenEnd = p + 1;
+                }
+#endif
             }
             break;
         }
@@ -772,8 +788,9 @@ void processSubject(const unsigned char * subject)
             if ( prevState == true ) {
                 // at the separator/token boundary
 
-                for ( int k = 0; separatorHashTable[ k ].hash != 0; k++ ) {
-                    if ( separatorHashTable[ k ].hash == hash ) {
+                const tSeparatorIndex * separator = lookupSeparator( separatorStart, p - separatorStart );
+                if ( separator != NULL ) {
+                    {
 
 #ifdef DEBUG
                         if ( tokenStart == separatorStart ) {
@@ -784,7 +801,7 @@ void processSubject(const unsigned char * subject)
 #endif
                             prev2Token = prevToken;
                             prevToken = token;
-                            token = identifyToken( prevHash, tokenStart, separatorStart - tokenStart );
+                            token = identifyToken( tokenStart, separatorStart - tokenStart );
 
                             switch ( token ) {
                             case kToken_Quoted:
@@ -819,9 +836,9 @@ void processSubject(const unsigned char * subject)
 #endif
 
                         for ( int j = 0; j < 2; j++ ) {
-                            logDebug(" %s", sepTokenToString[ separatorHashTable[ k ].index[ j ]]);
+                            logDebug(" %s", sepTokenToString[ separator[ j ]]);
 
-                            switch ( separatorHashTable[ k ].index[ j ] ) {
+                            switch ( separator[ j ] ) {
 
                             case kSep_startSq:              // '[', '[ ', ' [', ' [ '
                             case kSep_startQuotes:          // ' "',
@@ -856,7 +873,6 @@ void processSubject(const unsigned char * subject)
                         logDebug(" [%d,%d]\n", tokenLevel, levelChanges);
 #endif
                         tokenStart = p;
-                        break;
                     }
                 }
                 prevHash = hash;
@@ -867,18 +883,147 @@ void processSubject(const unsigned char * subject)
         hash ^= ( hash * 47 ) + *p;
 #endif
         wasEndRun = endRun;
-    } while ( *p++ != '\0' );
+
+        if ( earlyExit && resolved < info->tokenCount && resolved < kMaxSubjectTokens ) {
+            /* once the filename and counter are known, the rest can't change them */
+            bool known = false;
+            while ( resolved < info->tokenCount && resolved < kMaxSubjectTokens && !known ) {
+                known = resolveToken(&scratch, &resolution, subject, &info->tokens[ resolved++ ]);
+            }
+            if ( known ) {
+                info->partial = p + 1 < end;
+                break;
+            }
+        }
+    } while ( p++ < end );
 
 #ifdef DEBUG
-    unsigned int i = (unsigned int) (p - subj - 1);
+    unsigned int i = (unsigned int) (p - subject - 1);
+    if ( i >= sizeof(debug[ 0 ])) i = sizeof(debug[ 0 ]) - 1;
     for ( int j = 0; j < 4; j++ ) {
         debug[ j ][ i ] = '\0';
         logDebug("%d: %s\n", j, debug[ j ]);
     }
 #endif
+}
 
-    free(subj);
-    free((void *) filename);
+/**
+ * tokenize the trimmed subject, with its family's parser if allowed and it
+ * has one, otherwise with the generic tokenizer.
+ */
+static void parseSubject(tParseFlags flags, const byte * subject, tSubjectInfo * info) {
+    if ( (flags & kParse_Families)
+         && parseFamily(classifyFamily(subject, info->trimmed.length), subject, info)) {
+        return;
+    }
+    tokenizeSubject(subject, info, flags);
+}
+
+void processSubject(tDocument * document, const byte * subject, size_t length, tSubjectInfo * info)
+{
+    tParseFlags flags = document->flags;
+    struct timespec start;
+
+    info->trimmed.offset = 0;
+    info->trimmed.length = (unsigned int) preprocessSubject(document, subject, length);
+    info->partial = false;
+
+    if ( flags & kParse_Statistics ) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    bool matched = false;
+    if ( flags & kParse_Templates ) {
+        matched = matchTemplate(document->subjectTemplate, subject, info);
+        if ( !matched ) {
+            parseSubject(flags, subject, info);
+            learnTemplate(&document->subjectTemplate, subject, info);
+        }
+    } else {
+        parseSubject(flags, subject, info);
+    }
+    resolveSubject(info, subject);
+
+    if ( flags & kParse_Statistics ) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t elapsed = (uint64_t) (now.tv_sec - start.tv_sec) * 1000000000 + (now.tv_nsec - start.tv_nsec);
+
+        tTemplateStats * stats = &document->templateStats;
+        stats->subjects++;
+        if ( matched ) {
+            stats->matched++;
+            stats->matchNanoseconds += elapsed;
+        } else {
+            stats->tokenizeNanoseconds += elapsed;
+        }
+    }
+
+    if ( info->filename.length > 0 ) {
+        setFilename(subject + info->filename.offset, (int) info->filename.length);
+    }
+    if ( (flags & kParse_Results) && document->out != NULL) {
+        fprintf(document->out, "r: %u/%u \"%.*s\"\n", info->index, info->total,
+                (int) info->filename.length, subject + info->filename.offset);
+        if ( flags & kParse_Tokens ) {
+            /* each as its kind, type and terminator, then the text of it */
+            unsigned int count = info->tokenCount < kMaxSubjectTokens ? info->tokenCount : kMaxSubjectTokens;
+            fprintf(document->out, "t: %u%s", info->tokenCount, info->partial ? " partial" : "");
+            for ( unsigned int i = 0; i < count; i++ ) {
+                const tSubjectToken * token = &info->tokens[ i ];
+                fprintf(document->out, " %d/%d/%02x \"%.*s\"", token->kind, token->type, token->terminator,
+                        (int) token->span.length, subject + token->span.offset);
+            }
+            fputc('\n', document->out);
+        }
+    }
+}
+
+/**
+ * An attribute value or element content being accumulated from the parser's runs.
+ * Always zero-terminated; grows as needed, so nothing is ever truncated.
+ */
+typedef struct {
+    char * text;
+    size_t length;
+    size_t size;
+} tValue;
+
+static inline void clearValue(tValue * value) {
+    value->length = 0;
+    value->text[ 0 ] = '\0';
+}
+
+/**
+ * append a run of characters, in amortized O(1) per run.
+ * @return false if out of memory, in which case the value is unchanged
+ */
+bool appendValue(tValue * value, const char * run, size_t runLen) {
+    if ( value->length + runLen >= value->size ) {
+        size_t size = value->size * 2;
+        while ( value->length + runLen >= size ) size *= 2;
+
+        char * text = realloc(value->text, size);
+        if ( text == NULL) {
+            return false;
+        }
+        value->text = text;
+        value->size = size;
+    }
+    memcpy(&value->text[ value->length ], run, runLen);
+    value->length += runLen;
+    value->text[ value->length ] = '\0';
+    return true;
+}
+
+/**
+ * same as trimstr(), but working back from the known length.
+ */
+static inline void trimValue(tValue * value) {
+    while ( value->length > 0 && !isgraph((byte) value->text[ value->length - 1 ])) {
+        value->length--;
+    }
+    value->text[ value->length ] = '\0';
 }
 
 void processElement(tElement * element) {
@@ -890,141 +1035,469 @@ void processElement(tElement * element) {
               attribute != NULL;
               attribute = attribute->next )
         {
-            logDebug( "     >  %s: \'%s\'\n", describeHash(attribute->attributeHash ), attribute->value );
+            logDebug( "     >  %s: \'%s\'\n", describeHash(attribute->attributeHash ),
+                      attribute->value != NULL ? attribute->value : "(processed)" );
         }
     }
 #endif
 }
 
-int processFile(FILE * file) {
-    yxml_t xml;
-    yxml_ret_t r = YXML_OK;
-    char buffer[4096];
-    char value[1024];
+/* enough for the start of "</segments" or "<![CDATA[" */
+#define kSkipCarry  16
+
+/* an NZB being parsed, possibly fed in pieces */
+struct sParser {
+    tDocument  * document;
+    yxml_t       xml;
+    char         buffer[4096];
+    tValue       value;
+    tArena       arena;         // the element stack, its attributes and their values
+    tElement   * element;
+    tAttribute * attribute;
+    int          level;
+    yxml_ret_t   result;        // the first error, which stops the parse
+
+    /* kParse_SubjectsOnly: looking for the </segments to skip to, which may be
+     * in a later piece. skipUntil is the end of the comment, CDATA section or
+     * PI being skipped, if one is; skipCarry what ended the last piece that
+     * could be the start of something, and has to be looked at again */
+    bool         skipping;
+    const char * skipUntil;
+    byte         skipCarry[ kSkipCarry ];
+    unsigned int skipCarried;
+
+    /* the <file> being parsed, for the document's onFile and index */
+    tFileResult  file;
+    const char * fileSubject;   // kept in the arena until the file closes
+    size_t       fileSubjectLength;
+    tSubjectInfo fileInfo;
+};
+
+static const char segmentsEnd[] = "</segments";
+#define kSegmentsEndLength  (sizeof(segmentsEnd) - 1)
+
+/* what can turn up among the segments, and where each ends */
+static const struct {
+    const char * open;
+    const char * close;
+} skippedMarkup[] = {
+    { "<!--",      "-->" },
+    { "<![CDATA[", "]]>" },
+    { "<?",        "?>" },
+};
+
+/**
+ * skip elements, text, comments, CDATA sections and PIs from p, looking for
+ * the </segments end tag: one inside a comment doesn't count.
+ * @return where to carry on parsing: at the end tag, or at markup that's
+ *         for yxml to report (skipping is then over), or end; tail is set
+ *         to where the bytes at the end that need more data to decide start
+ */
+static const byte * scanSkipped(tParser * parser, const byte * p, const byte * end, const byte ** tail) {
+    *tail = end;
+    for (;;) {
+        if ( parser->skipUntil != NULL) {
+            size_t n = strlen(parser->skipUntil);
+            const byte * close = findString(p, end, parser->skipUntil, n);
+            if ( close == NULL) {
+                *tail = (size_t) (end - p) < n - 1 ? p : end - (n - 1);
+                return end;
+            }
+            p = close + n;
+            parser->skipUntil = NULL;
+        }
+
+        /* the end tag, unless there's markup before it that could hide one */
+        const byte * q = findTagOrMarkup(p, end, segmentsEnd, kSegmentsEndLength);
+        if ( q != NULL && q[ 1 ] == '/' ) {
+            parser->skipping = false;
+            return q;
+        }
+        if ( q == NULL) {
+            for ( size_t n = kSegmentsEndLength - 1; n > 0; n-- ) {
+                if ( (size_t) (end - p) >= n && memcmp(end - n, segmentsEnd, n) == 0 ) {
+                    *tail = end - n;
+                    break;
+                }
+            }
+            return end;
+        }
+        size_t left = (size_t) (end - q);
+
+        /* skipMarkup() would pass a DOCTYPE too, which has no place here */
+        const byte * after = left >= 3 && q[ 2 ] == 'D' ? NULL : skipMarkup(q, end);
+        if ( after != NULL) {
+            p = after;
+            continue;
+        }
+        /* its end is in a later piece, or there's not enough of it to tell what it is */
+        p = NULL;
+        for ( size_t i = 0; i < sizeof(skippedMarkup) / sizeof(skippedMarkup[ 0 ]); i++ ) {
+            size_t n = strlen(skippedMarkup[ i ].open);
+            if ( memcmp(q, skippedMarkup[ i ].open, left < n ? left : n) == 0 ) {
+                if ( left < n ) {
+                    *tail = q;
+                    return end;
+                }
+                parser->skipUntil = skippedMarkup[ i ].close;
+                p = q + n;
+                break;
+            }
+        }
+        if ( p == NULL) {
+            /* a DOCTYPE, or worse */
+            parser->skipping = false;
+            return q;
+        }
+    }
+}
+
+/**
+ * skip the contents of <segments>, up to its end tag, which can be cut in
+ * two by the end of a piece, like anything else. What ended the previous
+ * piece is looked at again along with the start of this one; if the end tag
+ * started in it, the part of it that was skipped is given to yxml now.
+ * @return where to carry on parsing: data's end if the tag wasn't found
+ */
+static const byte * skipSegments(tParser * parser, const byte * data, const byte * end) {
+    const byte * tail;
+    if ( parser->skipCarried > 0 ) {
+        byte joined[ 2 * kSkipCarry ];
+        size_t carried = parser->skipCarried;
+        size_t taken = (size_t) (end - data) < kSkipCarry ? (size_t) (end - data) : kSkipCarry;
+        memcpy(joined, parser->skipCarry, carried);
+        memcpy(joined + carried, data, taken);
+        parser->skipCarried = 0;
+
+        const byte * stop = scanSkipped(parser, joined, joined + carried + taken, &tail);
+        if ( !parser->skipping ) {
+            for ( const byte * c = stop; c < joined + carried && parser->result >= 0; c++ ) {
+                parser->result = yxml_parse(&parser->xml, *c);
+            }
+            return stop < joined + carried ? data : data + (stop - joined - carried);
+        }
+        if ( taken == (size_t) (end - data)) {
+            parser->skipCarried = (unsigned int) (joined + carried + taken - tail);
+            memcpy(parser->skipCarry, tail, parser->skipCarried);
+            return end;
+        }
+        /* nothing undecided is long enough to reach back into what was carried */
+        data += (tail - joined) - carried;
+    }
+
+    const byte * stop = scanSkipped(parser, data, end, &tail);
+    if ( parser->skipping ) {
+        parser->skipCarried = (unsigned int) (end - tail);
+        memcpy(parser->skipCarry, tail, parser->skipCarried);
+    }
+    return stop;
+}
+
+/** @return the number an attribute holds, as strtoull() would read it, but without a sign */
+static uint64_t attributeNumber(const char * value) {
+    const byte * p = (const byte *) value;
+    while ( isXmlSpace(*p)) p++;
+    uint64_t result;
+    parseDecimal(p, p + strlen((const char *) p), &result);
+    return result;
+}
+
+/** add a closing <segment> to the file's totals, and to the index */
+static void closeSegment(tParser * parser, const tElement * segment) {
+    uint64_t number = 0;
+    uint64_t bytes = 0;
+    for ( const tAttribute * attribute = segment->attributes; attribute != NULL; attribute = attribute->next ) {
+        if ( attribute->value == NULL) {
+            continue;
+        }
+        if ( attribute->attributeHash == kHash_Bytes ) {
+            bytes = attributeNumber(attribute->value);
+        } else if ( attribute->attributeHash == kHash_Number ) {
+            number = attributeNumber(attribute->value);
+        }
+    }
+
+    parser->file.segments++;
+    parser->file.bytes += bytes;
+    if ( parser->document->index != NULL) {
+        const char * messageId = segment->contents != NULL ? segment->contents : "";
+        /* the index has 32 bits for each: too big is as big as they go */
+        addIndexSegment(parser->document->index, number > UINT32_MAX ? UINT32_MAX : (uint32_t) number,
+                        bytes > UINT32_MAX ? UINT32_MAX : (uint32_t) bytes, messageId, strlen(messageId));
+    }
+}
+
+/** report the closing <file>: its subject is in the arena, so it must be now */
+static void closeFile(tParser * parser) {
+    tDocument * document = parser->document;
+    if ( document->onFile != NULL) {
+        describeFile(&parser->file, parser->fileSubject, parser->fileSubjectLength, &parser->fileInfo);
+        document->onFile(document->context, &parser->file);
+    }
+    if ( document->index != NULL) {
+        closeIndexFile(document->index, parser->fileSubject, parser->fileSubjectLength, parser->fileInfo.filename);
+    }
+}
+
+tParser * createParser(tDocument * document) {
+    tParser * parser = calloc(1, sizeof(tParser));
+    if ( parser == NULL) {
+        return NULL;
+    }
+    parser->value.text = malloc(1024);
+    if ( parser->value.text == NULL) {
+        free(parser);
+        return NULL;
+    }
+    parser->value.size = 1024;
+    clearValue(&parser->value);
 
-    int level = 0;
-    yxml_init(&xml, buffer, sizeof(buffer));
+    parser->document = document;
+    yxml_init(&parser->xml, parser->buffer, sizeof(parser->buffer));
+    arenaInit(&parser->arena);
+    return parser;
+}
+
+int feedParser(tParser * parser, const byte * data, size_t length) {
+    tParseFlags flags = parser->document->flags;
+    yxml_t * xml = &parser->xml;
+    tValue * value = &parser->value;
+    tArena * arena = &parser->arena;
+    tElement * element = parser->element;
+    tAttribute * attribute = parser->attribute;
+    int level = parser->level;
+    yxml_ret_t r = parser->result;
+
+    /* for the callback or the index, each file's subject is kept until it closes */
+    bool keepFiles = parser->document->onFile != NULL || parser->document->index != NULL;
+    /* and its segments counted, so parse what we can of them without yxml (see
+     * nzb-segments.h): not on the reference path, nor when they're skipped */
+    bool scanning = keepFiles && !(flags & (kParse_ByteWise | kParse_SubjectsOnly));
 
-    tElement * element = NULL;
-    tAttribute * attribute = NULL;
     tElement * newElement;
-    int ch;
-    while ((ch = fgetc(file)) != EOF) {
-        r = yxml_parse(&xml, ch);
+    const char * p = (const char *) data;
+    const char * end = p + length;
+    if ( r >= 0 && parser->skipping ) {
+        p = (const char *) skipSegments(parser, (const byte *) p, (const byte *) end);
+        r = parser->result;
+    }
+    while ( r >= 0 && p < end ) {
+        if ( flags & kParse_ByteWise ) {
+            r = yxml_parse(xml, *p++);
+            xml->run = xml->data;
+            xml->runlen = strlen(xml->data);
+        } else {
+            r = yxml_parse_buf(xml, &p, end);
+        }
         switch ( r ) {
-        case YXML_ELEMSTART:
+        case YXML_ELEMSTART: {
 #ifdef DEBUG_VERBOSE
-            logDebug( "%d  ElemStart %s = 0x%016lx\n", level, xml.elem, hashString( xml.elem ) );
+            logDebug( "%d  ElemStart %s = 0x%016lx\n", level, xml->elem, hashString( xml->elem ) );
 #endif
-            if ((newElement = calloc(1, sizeof(tElement))) != NULL) {
-                newElement->elementHash = hashString(xml.elem, 0);
+            tArenaMark mark = arenaMark(arena);
+            if ((newElement = arenaAlloc(arena, sizeof(tElement))) != NULL) {
+                newElement->mark = mark;
+                newElement->elementHash = hashString(xml->elem, 0);
 
                 /* push new entry on the element stack */
                 newElement->next = element;
                 element = newElement;
             }
             level++;
-            value[ 0 ] = '\0';
+            clearValue(value);
+
+            if ( keepFiles && element != NULL && element->elementHash == kHash_File ) {
+                memset(&parser->file, 0, sizeof(tFileResult));
+                memset(&parser->fileInfo, 0, sizeof(tSubjectInfo));
+                parser->fileSubject = "";
+                parser->fileSubjectLength = 0;
+                if ( parser->document->index != NULL) {
+                    openIndexFile(parser->document->index);
+                }
+            }
+
+            /* Nothing inside <segments> contributes to the subject, so jump straight to
+             * its closing tag and let the parser pick up from there, in whichever piece
+             * of the document it turns up. Only possible once the start tag is complete,
+             * i.e. ELEMSTART was triggered by its '>'.
+             * Note that xml.line, xml.byte and xml.total don't count skipped bytes. */
+            if ( (flags & kParse_SubjectsOnly) && element != NULL
+                 && element->elementHash == kHash_Segments && p[ -1 ] == '>' ) {
+                parser->skipping = true;
+                p = (const char *) skipSegments(parser, (const byte *) p, (const byte *) end);
+            }
+            /* the same goes for scanning them, which stops short of anything unusual */
+            if ( scanning && element != NULL && element->elementHash == kHash_Segments && p[ -1 ] == '>' ) {
+                p = (const char *) scanSegments((const byte *) p, (const byte *) end, parser->document->index,
+                                                &parser->file.segments, &parser->file.bytes);
+            }
             break;
+        }
 
         case YXML_ATTRSTART:
 #ifdef DEBUG_VERBOSE
-            logDebug( "   AttrStart %s = 0x%016lx\n", xml.attr, hashString( xml.attr ) );
+            logDebug( "   AttrStart %s = 0x%016lx\n", xml->attr, hashString( xml->attr ) );
 #endif
-            if ((attribute = calloc(1, sizeof(tAttribute))) != NULL) {
-                attribute->attributeHash = hashString(xml.attr, 0);
+            if ( element != NULL && (attribute = arenaAlloc(arena, sizeof(tAttribute))) != NULL) {
+                attribute->attributeHash = hashString(xml->attr, 0);
+                attribute->next = element->attributes;
+                element->attributes = attribute;
             }
-            attribute->next = element->attributes;
-            element->attributes = attribute;
-            value[ 0 ] = '\0';
+            clearValue(value);
             break;
 
         case YXML_ATTRVAL:
         case YXML_CONTENT:
-            strncat(value, xml.data, sizeof(value) - 2);
+            if ( !appendValue(value, xml->run, xml->runlen)) {
+                /* no room for the value: as good as running out of stack */
+                r = YXML_ESTACK;
+            }
             break;
 
         case YXML_ATTREND:
 #ifdef DEBUG_VERBOSE
-            logDebug( "   AttrEnd %s \'%s\'\n", xml.attr, value );
+            logDebug( "   AttrEnd %s \'%s\'\n", xml->attr, value->text );
 #endif
-            attribute->value = strdup(value);
-            if ( element->elementHash == kHash_File && attribute->attributeHash == kHash_Subject ) {
-                processSubject(attribute->value);
+            if ( element != NULL && attribute != NULL) {
+                if ( element->elementHash == kHash_File && attribute->attributeHash == kHash_Subject ) {
+                    if ( keepFiles ) {
+                        /* kept until the file closes, so its spans must outlive the value */
+                        char * subject = arenaStrndup(arena, value->text, value->length);
+                        if ( subject != NULL) {
+                            attribute->value = subject;
+                            parser->fileSubject = subject;
+                            parser->fileSubjectLength = value->length;
+                            processSubject(parser->document, (const byte *) subject, value->length,
+                                           &parser->fileInfo);
+                        }
+                    } else {
+                        /* tokenized right where it is, so the subject itself is never copied */
+                        tSubjectInfo info;
+                        processSubject(parser->document, (const byte *) value->text, value->length, &info);
+                    }
+                } else {
+                    attribute->value = arenaStrndup(arena, value->text, value->length);
+                }
             }
 
-            value[ 0 ] = '\0';
+            clearValue(value);
             break;
 
         case YXML_ELEMEND:
             --level;
 #ifdef DEBUG_VERBOSE
-            logDebug( "%d  ElemEnd %s \'%s\'\n", level, xml.elem, value );
+            logDebug( "%d  ElemEnd %s \'%s\'\n", level, xml->elem, value->text );
 #endif
             if ( element != NULL) {
-                void * temp;
-
-                trimstr(value);
-                if ( strlen(value) > 0 ) {
-                    element->contents = strdup(value);
-                    value[ 0 ] = '\0';
+                trimValue(value);
+                if ( value->length > 0 ) {
+                    element->contents = arenaStrndup(arena, value->text, value->length);
+                    clearValue(value);
                 }
 
                 processElement(element);
-
-                // release attributes assigned to the element at the top of the element stack
-                attribute = element->attributes;
-                while ( attribute != NULL) {
-                    temp = attribute;
-                    attribute = attribute->next;
-                    free(temp);
+                if ( keepFiles ) {
+                    if ( element->elementHash == kHash_Segment ) {
+                        closeSegment(parser, element);
+                    } else if ( element->elementHash == kHash_Group ) {
+                        if ( parser->document->index != NULL && element->contents != NULL) {
+                            addIndexGroup(parser->document->index, element->contents);
+                        }
+                    } else if ( element->elementHash == kHash_File ) {
+                        closeFile(parser);
+                    }
                 }
-                // 'pop' the top of the element stack, and release its memory
-                temp = element;
+
+                // 'pop' the top of the element stack. Rewinding the arena releases the
+                // element, its attributes and their values, and anything its children left.
+                tArenaMark mark = element->mark;
                 element = element->next;
-                free(temp);
+                attribute = NULL;
+                arenaRewind(arena, mark);
+
+                /* yxml had a segment scanning stopped at: carry on after it */
+                if ( scanning && element != NULL && element->elementHash == kHash_Segments && p[ -1 ] == '>' ) {
+                    p = (const char *) scanSegments((const byte *) p, (const byte *) end, parser->document->index,
+                                                    &parser->file.segments, &parser->file.bytes);
+                }
             }
             break;
 
         default:
-            if ( r < 0 ) {
-                fprintf(stderr, "xml parser error %d\n", r);
-                exit(r);
-            }
             break;
         }
     }
 
-    r = yxml_eof(&xml);
-    if ( r != YXML_OK ) {
-        fprintf(stderr, "xml error %d at end of file", r);
+    parser->element = element;
+    parser->attribute = attribute;
+    parser->level = level;
+    if ( parser->result >= 0 ) {
+        parser->result = r < 0 ? r : YXML_OK;
+    }
+    return parser->result;
+}
+
+int finishParser(tParser * parser) {
+    yxml_ret_t r = parser->result;
+    if ( r >= 0 ) {
+        r = yxml_eof(&parser->xml);
     }
 
+    if ( parser->document->flags & kParse_Statistics ) {
+        tArenaStats * stats = &parser->arena.stats;
+        fprintf(stderr, "arena: %lu allocations, %lu bytes, %lu malloc() calls, %zu bytes peak\n",
+                stats->allocations, stats->bytes, stats->blocks, stats->highWater);
+    }
+    arenaRelease(&parser->arena);
+    free(parser->value.text);
+    free(parser);
+
     return r;
 }
 
-int main(int argc, const char * argv[]) {
-    const char * myName = strrchr(argv[ 0 ], '/');
-    if ( myName++ == NULL) {
-        myName = argv[ 0 ];
+int processFile(tDocument * document, const byte * data, size_t length) {
+    tParser * parser = createParser(document);
+    if ( parser == NULL) {
+        return -ENOMEM;
     }
 
-    if ( argc < 2 ) {
-        processFile(stdin);
+    int r = feedParser(parser, data, length);
+    if ( r < 0 ) {
+        fprintf(stderr, "xml parser error %d\n", r);
+    }
+    r = finishParser(parser);
+    if ( r == YXML_EEOF ) {
+        fprintf(stderr, "xml error %d at end of file", r);
+    }
+    return r;
+}
+
+int processInput(tDocument * document, const byte * data, size_t length) {
+    int result;
+
+    /* the whole-document engines can't report files as they close, or index them */
+    bool streaming = document->onFile != NULL || document->index != NULL;
+    if ( !streaming && (document->flags & kParse_Prefilter) && prefilterFile(document, data, length) == 0 ) {
+        result = 0;
+    } else if ( !streaming && (document->flags & kParse_Split) ) {
+        result = splitFile(document, data, length);
     } else {
-        for ( int i = 1; i < argc; ++i ) {
-            FILE * file = fopen(argv[ i ], "r");
-            if ( file == NULL) {
-                fprintf(stderr,
-                        "### %s: error: unable to open \'%s\' (%d: %s)\n",
-                        myName, argv[ i ], errno, strerror(errno));
-                exit(-errno);
-            } else {
-                processFile(file);
-                fclose(file);
-            }
-        }
+        result = processFile(document, data, length);
+    }
+
+    const tTemplateStats * stats = &document->templateStats;
+    if ( (document->flags & kParse_Statistics) && (document->flags & kParse_Templates) && stats->subjects > 0 ) {
+        /* what the matched subjects would have cost at the tokenizer's average */
+        unsigned int tokenized = stats->subjects - stats->matched;
+        double tokenizeAverage = tokenized > 0 ? (double) stats->tokenizeNanoseconds / tokenized : 0.0;
+        double saved = stats->matched * tokenizeAverage - (double) stats->matchNanoseconds;
+        fprintf(stderr, "templates: %u of %u subjects matched (%.1f%%), ~%.1f us saved\n",
+                stats->matched, stats->subjects, 100.0 * stats->matched / stats->subjects, saved / 1000.0);
     }
+    return result;
+}
 
-    return 0;
+void releaseDocument(tDocument * document) {
+    releaseTemplate(document->subjectTemplate);
+    document->subjectTemplate = NULL;
 }
@@ -0,0 +1,201 @@
+
+#ifndef NZB_SUBJECT_H
+#define NZB_SUBJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nzb-keywords.h"
+
+typedef unsigned char byte;
+
+typedef enum {
+    kParse_Default      = 0,
+    kParse_ByteWise     = 1 << 0,   // feed yxml_parse() one byte at a time, the reference path
+    kParse_SubjectsOnly = 1 << 1,   // skip over the contents of <segments> without parsing it
+    kParse_Prefilter    = 1 << 2,   // try the SIMD subject prefilter before falling back to yxml
+    kParse_Statistics   = 1 << 3,   // report parser statistics on stderr
+    kParse_Split        = 1 << 4,   // parse large documents in pieces, on several threads
+    kParse_Templates    = 1 << 5,   // learn the shape of the document's subjects, and match against it
+    kParse_Families     = 1 << 6,   // tokenize the common kinds of subject with parsers of their own
+    kParse_EarlyExit    = 1 << 7,   // stop tokenizing a subject once its filename and counter are known
+    kParse_Results      = 1 << 8,   // print what was made of each subject: its counter and filename
+    kParse_Tokens       = 1 << 9    // with kParse_Results, its tokens too
+} tParseFlags;
+
+typedef struct sSubjectTemplate tSubjectTemplate;
+
+/* collected with kParse_Statistics */
+typedef struct {
+    unsigned int subjects;
+    unsigned int matched;               // by the template, without running the tokenizer
+    uint64_t     tokenizeNanoseconds;   // spent on the others
+    uint64_t     matchNanoseconds;
+} tTemplateStats;
+
+/* what was made of one <file>: see nzb-api.h */
+typedef struct sFileResult tFileResult;
+
+typedef void (* tFileCallback)(void * context, const tFileResult * file);
+
+/* the files, segments and groups of an NZB: see nzb-index.h */
+typedef struct sNzbIndex tNzbIndex;
+
+/* per-document state, owned by whichever thread processes the document */
+typedef struct {
+    tParseFlags        flags;
+    FILE             * out;             // where the results are written, NULL for nowhere
+    unsigned int       threads;         // for kParse_Split; 0 means one per CPU
+    tSubjectTemplate * subjectTemplate; // for kParse_Templates, learned as we go
+    tTemplateStats     templateStats;
+    tFileCallback      onFile;          // if set, called as each <file> closes
+    void             * context;
+    tNzbIndex        * index;           // if set, filled in with the document's files.
+                                        // Only the yxml parser can do either, so it's used
+} tDocument;
+
+/** free whatever the document picked up while being processed */
+void releaseDocument(tDocument * document);
+
+/* part of a subject, as an offset and length into it */
+typedef struct {
+    unsigned int offset;
+    unsigned int length;
+} tSpan;
+
+#define kMaxSubjectTokens  32
+
+typedef struct {
+    tTokenType    kind;         // kToken_Unquoted (a word), kToken_Quoted or kToken_String ([bracketed])
+    tTokenType    type;         // what it is: a keyword, a number, ... or kToken_Empty for ""
+    tSpan         span;
+    unsigned char terminator;   // the character that ended it: '"', ']', ' ', '-' or '\0'
+} tSubjectToken;
+
+/**
+ * What the tokenizer made of a subject. Nothing is copied: everything
+ * refers back to the subject by offset, so it stays valid only as long
+ * as the subject does. Use materializeSpan() to keep a piece of it.
+ */
+typedef struct {
+    tSpan         trimmed;      // the subject less any yEnc suffix
+    tSpan         filename;     // length 0 if none was found
+    unsigned int  index;        // from the first n/m counter, 0 if none was found
+    unsigned int  total;
+    bool          confident;    // the filename and counter were both found
+    bool          partial;      // kParse_EarlyExit stopped the tokenizer once they were:
+                                // the tokens cover only the start of the subject
+    unsigned int  tokenCount;   // may exceed kMaxSubjectTokens, only the first ones are kept
+    tSubjectToken tokens[ kMaxSubjectTokens ];
+} tSubjectInfo;
+
+/** @return the type of a token of the given kind (kToken_Unquoted, _Quoted or _String) */
+tTokenType tokenType(tTokenType kind, const byte * str, size_t len);
+
+/** @return the length of the subject without any yEnc suffix */
+size_t trimSubject(const byte * subject, size_t length);
+
+/**
+ * run the generic tokenizer over the trimmed subject (info->trimmed),
+ * filling in info's tokens. With kParse_EarlyExit in flags, it stops as
+ * soon as the filename and counter are known; otherwise it always scans
+ * the whole subject, which is what diagnostics want.
+ */
+void tokenizeSubject(const byte * subject, tSubjectInfo * info, tParseFlags flags);
+
+/**
+ * tokenize the length bytes at subject (not necessarily zero-terminated),
+ * in place.
+ */
+void processSubject(tDocument * document, const byte * subject, size_t length, tSubjectInfo * info);
+
+/** @return a zero-terminated copy of the span of subject, or NULL if out of memory */
+char * materializeSpan(const byte * subject, tSpan span);
+
+/**
+ * parse an NZB with yxml, processing the subject of every file.
+ * @return 0, or a negative yxml_ret_t error. Only YXML_EEOF (a truncated
+ *         document) still produced results for the whole input.
+ */
+int processFile(tDocument * document, const byte * data, size_t length);
+
+/*
+ * The helpers behind processFile() and processSubject(), for the
+ * micro-benchmarks.
+ */
+
+/* hashes of the element and attribute names, as made by hashString() */
+typedef enum {
+    kHash_Unset = 0,
+    kHash_Empty = 0xDeadBeef,
+    kHash_OneSpace = 0x000000283f4bb0ee, // hash after parsing a single space
+
+    // elements
+    kHash_NZB = 0x000151a90eb474b2,
+    kHash_Segments = 0x57ef75389804b12b,
+    kHash_Segment = 0x78d5ad74034dd104,
+    kHash_Head = 0x003cafa0bdb94552,
+    kHash_Meta = 0x003cafa0bd974cbd,
+    kHash_Groups = 0x029a347370b2f5eb,
+    kHash_Group = 0x0b18912267fc3ade,
+    kHash_File = 0x003cafa0bdeb36b1,
+
+    // attributes
+    kHash_Xmlns = 0x0b189122f49400cb,
+    kHash_Type = 0x003cafa0badc89f9,
+    kHash_Subject = 0x78d5adc5d7a0afe2,
+    kHash_Date = 0x003cafa0bda6aa31,
+    kHash_Bytes = 0x0b189122f1c044a3,
+    kHash_Number = 0x029a34715398d358,
+    kHash_Poster = 0x029a344bcb84b4a0,
+
+    // guarantee the enum width is at least 64 bits
+    kHash_ForceWidth = 0x8070605040302010
+} tHash;
+
+typedef unsigned long tSignature;
+
+tHash hashString(const unsigned char * string, const int maxLen);
+
+/** @return the token type of a token that isn't quoted */
+tSignature identifyToken(const byte * str, size_t len);
+
+/** @return the last occurrence of needle in the zero-terminated haystack, or NULL */
+unsigned char * strrstr(unsigned char * haystack, const unsigned char * needle);
+
+/** print the subject, then trimSubject() it */
+size_t preprocessSubject(tDocument * document, const unsigned char * subject, size_t length);
+
+/**
+ * process one NZB, using the fastest engine the flags allow.
+ * @return as processFile()
+ */
+int processInput(tDocument * document, const byte * data, size_t length);
+
+/**
+ * The yxml parse behind processFile(), for feeding a document in pieces as
+ * they arrive - while it downloads, say. Everything the parse needs is kept
+ * in the parser between feeds, and the pieces can be cut anywhere: even in
+ * the middle of a tag, or of the </segments that kParse_SubjectsOnly skips
+ * to. Each file is reported to the document's onFile as soon as its end
+ * tag arrives. Errors are left to the caller to report.
+ */
+typedef struct sParser tParser;
+
+/** @return a parser for the document, or NULL if out of memory */
+tParser * createParser(tDocument * document);
+/**
+ * parse the next length bytes of the document. After an error, any
+ * further data is ignored.
+ * @return 0, or the first negative yxml_ret_t error
+ */
+int feedParser(tParser * parser, const byte * data, size_t length);
+/**
+ * check the document is complete, and free the parser.
+ * @return 0, or the first error, or YXML_EEOF if the document was truncated
+ */
+int finishParser(tParser * parser);
+
+#endif
@@ -0,0 +1,219 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nzb-template.h"
+
+/* longer subjects aren't worth a template */
+#define kTemplateMaxLength  1024
+
+/* subjects in a row that don't fit before the template is started over */
+#define kTemplateRelearn    4
+
+struct sSubjectTemplate {
+    size_t        length;                           // of sample
+    unsigned int  tokenCount;
+    unsigned int  misfits;                          // subjects in a row that didn't fit
+    bool          partial;                          // the tokenizer stopped early on sample
+    tSubjectToken tokens[ kMaxSubjectTokens ];      // spans into sample
+    bool          variable[ kMaxSubjectTokens ];
+    byte          sample[ kTemplateMaxLength ];     // the subject it was learned from
+};
+
+static inline bool isSeparator(byte c) {
+    return c == ' ' || c == '-' || c == '\0';
+}
+
+/**
+ * whether text can be the contents of a variable token of the given kind.
+ * Quotes and brackets would change the nesting, and inside a word any
+ * separator would split it.
+ */
+static bool canVary(tTokenType kind, const byte * text, size_t length) {
+    /* The tokenizer ignores one character words, and only starts a new one
+     * at the end of a run longer than that: after a one character quoted or
+     * bracketed token, the next word would start inside it ("[9 ]PRiVATE"
+     * gives "9 ]PRiVATE"), where after a longer one it starts at its end. */
+    size_t start = 0;
+    size_t end = length;
+    while ( start < end && isSeparator(text[ start ])) start++;
+    while ( end > start && isSeparator(text[ end - 1 ])) end--;
+    if ( end - start < 2 ) {
+        return false;
+    }
+    for ( size_t i = 0; i < length; i++ ) {
+        byte c = text[ i ];
+        if ( c == '"' || c == '[' || c == ']' || c == '\0' ) {
+            return false;
+        }
+        if ( kind == kToken_Unquoted && isSeparator(c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool matchTemplate(const tSubjectTemplate * template, const byte * subject, tSubjectInfo * info) {
+    if ( template == NULL) {
+        return false;
+    }
+
+    const byte * p = subject;
+    const byte * end = subject + info->trimmed.length;
+    size_t at = 0;      // how far we are in the sample
+
+    for ( unsigned int i = 0; i < template->tokenCount; i++ ) {
+        const tSubjectToken * token = &template->tokens[ i ];
+        tSubjectToken * result = &info->tokens[ i ];
+
+        /* the text in between has to be the same; the tokenizer can make
+         * tokens that overlap ("[a -]xyz" gives "a", then "a -]xyz"), which
+         * have no gap to compare */
+        if ( token->span.offset < at ) {
+            return false;
+        }
+        size_t gap = token->span.offset - at;
+        if ( (size_t) (end - p) < gap || memcmp(p, &template->sample[ at ], gap) != 0 ) {
+            return false;
+        }
+        p += gap;
+        at = token->span.offset + token->span.length;
+
+        *result = *token;
+        if ( !template->variable[ i ] ) {
+            if ( (size_t) (end - p) < token->span.length
+                 || memcmp(p, &template->sample[ token->span.offset ], token->span.length) != 0 ) {
+                return false;
+            }
+            result->span.offset = (unsigned int) (p - subject);
+            p += token->span.length;
+            continue;
+        }
+
+        /* a variable token runs up to the start of the next gap */
+        const byte * stop = end;
+        if ( at < template->length ) {
+            stop = memchr(p, template->sample[ at ], end - p);
+            if ( stop == NULL) {
+                return false;
+            }
+        }
+        if ( !canVary(token->kind, p, stop - p)) {
+            return false;
+        }
+
+        const byte * start = p;
+        const byte * finish = stop;
+        while ( start < finish && isSeparator(*start)) start++;
+        while ( start < finish && isSeparator(finish[ -1 ])) finish--;
+
+        result->type = tokenType(token->kind, start, finish - start);
+        result->span.offset = (unsigned int) (start - subject);
+        result->span.length = (unsigned int) (finish - start);
+        p = stop;
+    }
+
+    size_t tail = template->length - at;
+    if ( (size_t) (end - p) != tail || memcmp(p, &template->sample[ at ], tail) != 0 ) {
+        return false;
+    }
+    info->tokenCount = template->tokenCount;
+    info->partial = template->partial;
+    return true;
+}
+
+/**
+ * make the template cover the subject, by making the tokens that differ
+ * variable.
+ * @return false if the subject has a different shape
+ */
+static bool widenTemplate(tSubjectTemplate * template, const byte * subject, const tSubjectInfo * info) {
+    bool variable[ kMaxSubjectTokens ];
+    size_t at = 0;
+    size_t subjectAt = 0;
+
+    if ( info->tokenCount != template->tokenCount || info->partial != template->partial ) {
+        return false;
+    }
+    for ( unsigned int i = 0; i < template->tokenCount; i++ ) {
+        const tSubjectToken * token = &template->tokens[ i ];
+        const tSubjectToken * other = &info->tokens[ i ];
+
+        if ( token->kind != other->kind || token->terminator != other->terminator ) {
+            return false;
+        }
+        /* overlapping tokens leave no gap to compare, see matchTemplate() */
+        if ( token->span.offset < at || other->span.offset < subjectAt ) {
+            return false;
+        }
+        size_t gap = token->span.offset - at;
+        if ( other->span.offset - subjectAt != gap
+             || memcmp(&subject[ subjectAt ], &template->sample[ at ], gap) != 0 ) {
+            return false;
+        }
+
+        const byte * text = &template->sample[ token->span.offset ];
+        const byte * otherText = &subject[ other->span.offset ];
+        variable[ i ] = template->variable[ i ] || token->span.length != other->span.length
+                        || memcmp(text, otherText, token->span.length) != 0;
+        if ( variable[ i ] ) {
+            if ( !canVary(token->kind, text, token->span.length)
+                 || !canVary(other->kind, otherText, other->span.length)) {
+                return false;
+            }
+        }
+        at = token->span.offset + token->span.length;
+        subjectAt = other->span.offset + other->span.length;
+
+        /* the end of a variable token is found by the gap after it */
+        if ( variable[ i ] && i + 1 < template->tokenCount && template->tokens[ i + 1 ].span.offset == at ) {
+            return false;
+        }
+    }
+
+    size_t tail = template->length - at;
+    if ( info->trimmed.length - subjectAt != tail || memcmp(&subject[ subjectAt ], &template->sample[ at ], tail) != 0 ) {
+        return false;
+    }
+
+    memcpy(template->variable, variable, template->tokenCount * sizeof(bool));
+    return true;
+}
+
+void learnTemplate(tSubjectTemplate ** template, const byte * subject, const tSubjectInfo * info) {
+    tSubjectTemplate * learned = *template;
+    bool usable = info->trimmed.length <= kTemplateMaxLength && info->tokenCount <= kMaxSubjectTokens;
+
+    if ( learned != NULL) {
+        if ( usable && widenTemplate(learned, subject, info)) {
+            learned->misfits = 0;
+            return;
+        }
+        if ( ++learned->misfits < kTemplateRelearn ) {
+            return;
+        }
+    }
+    if ( !usable ) {
+        return;
+    }
+
+    if ( learned == NULL) {
+        learned = malloc(sizeof(tSubjectTemplate));
+        if ( learned == NULL) {
+            /* no template just means no shortcut */
+            return;
+        }
+        *template = learned;
+    }
+    learned->length = info->trimmed.length;
+    learned->tokenCount = info->tokenCount;
+    learned->misfits = 0;
+    learned->partial = info->partial;
+    memcpy(learned->sample, subject, info->trimmed.length);
+    memcpy(learned->tokens, info->tokens, info->tokenCount * sizeof(tSubjectToken));
+    memset(learned->variable, 0, sizeof(learned->variable));
+}
+
+void releaseTemplate(tSubjectTemplate * template) {
+    free(template);
+}
@@ -0,0 +1,37 @@
+
+#ifndef NZB_TEMPLATE_H
+#define NZB_TEMPLATE_H
+
+#include <stdbool.h>
+
+#include "nzb-subject.h"
+
+/**
+ * The subjects within one NZB nearly all have the same shape, e.g.
+ *   [PRiVATE]-[WtFnZb]-[<name>]-[<n>/<m>] - ""
+ * differing only in a few fields. A template is the tokens of one subject,
+ * with the fields seen to change marked as variable: everything else,
+ * including the text between the tokens, has to match byte for byte.
+ * A variable field may only contain characters that can't change how the
+ * tokenizer splits the subject, so a match gives exactly the tokens the
+ * tokenizer would have.
+ */
+
+/**
+ * match the (already trimmed) subject against the template.
+ * @return true if it matched, with info's tokens filled in; false if the
+ *         subject has to go through the tokenizer
+ */
+bool matchTemplate(const tSubjectTemplate * template, const byte * subject, tSubjectInfo * info);
+
+/**
+ * learn from a subject that didn't match, after it has been tokenized: start
+ * a template if there isn't one, widen the template if the subject differs
+ * only in fields that can vary, or start over if the last few subjects
+ * haven't fitted it at all.
+ */
+void learnTemplate(tSubjectTemplate ** template, const byte * subject, const tSubjectInfo * info);
+
+void releaseTemplate(tSubjectTemplate * template);
+
+#endif
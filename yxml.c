@@ -26,6 +26,9 @@
 
 #include "yxml.h"
 #include <string.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#endif
 
 typedef enum {
 	YXMLS_string,
@@ -1062,4 +1065,78 @@ yxml_ret_t yxml_eof(yxml_t *x) {
 }
 
 
+/* Everything below is a local addition to the generated parser: a buffer
+ * interface that lets the caller skip the per-byte state machine step for
+ * the bulk of an NZB, which is message-ids in element content. */
+
+/* Returns the first byte in [p, end) that can't be passed through verbatim
+ * while in element content or in an attribute value delimited by quote:
+ * markup and references, line endings (line counting and normalization),
+ * tabs (attribute value normalization), the closing quote and '\0' (an
+ * error). For element content, pass '<' as the quote. */
+static const char *yxml_scanrun(const char *p, const char *end, unsigned quote) {
+#if defined(__SSE2__) && defined(__GNUC__)
+	const __m128i lt   = _mm_set1_epi8('<');
+	const __m128i amp  = _mm_set1_epi8('&');
+	const __m128i lf   = _mm_set1_epi8('\n');
+	const __m128i cr   = _mm_set1_epi8('\r');
+	const __m128i tab  = _mm_set1_epi8('\t');
+	const __m128i quo  = _mm_set1_epi8((char)quote);
+	const __m128i zero = _mm_setzero_si128();
+	while(end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)),
+			             _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr))),
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, quo)),
+			             _mm_cmpeq_epi8(v, zero)));
+		unsigned mask = (unsigned)_mm_movemask_epi8(m);
+		if(mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	for(; p < end; p++) {
+		unsigned ch = (unsigned char)*p;
+		if(ch == '<' || ch == '&' || ch == '\n' || ch == '\r' || ch == '\t' || ch == quote || !ch)
+			break;
+	}
+	return p;
+}
+
+
+yxml_ret_t yxml_parse_buf(yxml_t *x, const char **buf, const char *end) {
+	const char *p = *buf;
+	yxml_ret_t r;
+
+	while(p < end) {
+		/* A pending '\r' still has to see the next byte via yxml_parse() */
+		if(!x->ignore && (x->state == YXMLS_misc2 || x->state == YXMLS_attr3)) {
+			const char *s = p;
+			p = yxml_scanrun(p, end, x->state == YXMLS_attr3 ? x->quote : '<');
+			if(p != s) {
+				x->run = s;
+				x->runlen = p - s;
+				x->byte += x->runlen;
+				x->total += x->runlen;
+				*buf = p;
+				return x->state == YXMLS_attr3 ? YXML_ATTRVAL : YXML_CONTENT;
+			}
+		}
+
+		r = yxml_parse(x, *p++);
+		if(r != YXML_OK) {
+			if(r == YXML_ATTRVAL || r == YXML_CONTENT || r == YXML_PICONTENT) {
+				x->run = x->data;
+				x->runlen = strlen(x->data);
+			}
+			*buf = p;
+			return r;
+		}
+	}
+	*buf = p;
+	return YXML_OK;
+}
+
+
 /* vim: set noet sw=4 ts=4: */
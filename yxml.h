@@ -95,6 +95,14 @@ typedef struct {
 	 */
 	char data[8];
 
+	/* Set together with YXML_ATTRVAL and YXML_CONTENT when those are returned
+	 * by yxml_parse_buf(): the characters of the run and its length. run
+	 * points either into the buffer given to yxml_parse_buf() or at data, and
+	 * is only valid until the next yxml_parse_buf() call. Not zero-terminated.
+	 * Not touched by yxml_parse(). */
+	const char *run;
+	size_t runlen;
+
 	/* Name of the current attribute. Changed after YXML_ATTRSTART, valid up to
 	 * and including the next YXML_ATTREND. */
 	char *attr;
@@ -134,6 +142,22 @@ void yxml_init(yxml_t *, void *, size_t);
 yxml_ret_t yxml_parse(yxml_t *, int);
 
 
+/* Buffer-at-a-time variant of yxml_parse(). Consumes bytes from *buf up to
+ * end, and returns as soon as a token other than YXML_OK is produced, with
+ * *buf advanced past the bytes consumed so far. Returns YXML_OK once the
+ * whole buffer has been consumed; an error is returned just like
+ * yxml_parse() would.
+ *
+ * While in element content or in an attribute value, a run of bytes that
+ * need no further processing (no '<', '&', quote, or line ending) is
+ * consumed in one step and returned as a single YXML_CONTENT or
+ * YXML_ATTRVAL token; see x->run and x->runlen. Other data tokens are
+ * returned one character at a time as usual, also via x->run.
+ *
+ * Calls to yxml_parse() and yxml_parse_buf() may be freely mixed. */
+yxml_ret_t yxml_parse_buf(yxml_t *, const char **, const char *);
+
+
 /* May be called after the last character has been given to yxml_parse().
  * Returns YXML_OK if the XML document is valid, YXML_EEOF otherwise.  Using
  * this function isn't really necessary, but can be used to detect documents